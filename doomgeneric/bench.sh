@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Run a set of demos through -timedemo several times each, appending the
+# -benchout results of every run to one file for comparison across builds.
+#
+# usage: bench.sh [-b binary] [-o results] [-l label] [-n repeats]
+#                 [-w warmup] listfile
+#
+# Each non-blank line of the list file not starting with # names an IWAD,
+# a demo lump or file, and optionally any PWADs to load with it:
+#
+#   doom2.wad demo1
+#   doom2.wad mydemo.lmp mymap.wad
+#
+# The output file format is chosen by its name, as for -benchout. The first
+# run of each demo is discarded, to warm the host's file and CPU caches.
+#
+
+binary=./doomgeneric-headless
+results=bench.csv
+label=$(git describe --always --dirty 2>/dev/null || echo unknown)
+repeats=5
+warmup=35
+
+while getopts b:o:l:n:w: opt; do
+    case $opt in
+    b) binary=$OPTARG ;;
+    o) results=$OPTARG ;;
+    l) label=$OPTARG ;;
+    n) repeats=$OPTARG ;;
+    w) warmup=$OPTARG ;;
+    *) sed -n '6,7s/^# //p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -ne 1 ]; then
+    sed -n '6,7s/^# //p' "$0" >&2
+    exit 2
+fi
+
+grep -v '^[[:space:]]*\(#\|$\)' "$1" | while read -r iwad demo pwads; do
+    set -- -iwad "$iwad" -nosound -timedemo "$demo"
+    if [ -n "$pwads" ]; then
+        # Deliberately split into one argument per PWAD.
+        set -- "$@" -file $pwads
+    fi
+
+    "$binary" "$@" -benchout /dev/null < /dev/null > /dev/null 2>&1
+
+    run=1
+    while [ $run -le "$repeats" ]; do
+        echo "$label: $iwad $demo${pwads:+ $pwads} ($run/$repeats)"
+
+        # -timedemo always ends through I_Error, so the exit status
+        # doesn't tell us anything; -benchout still writes its results.
+        "$binary" "$@" -benchout "$results" -benchlabel "$label" \
+                  -benchwarmup "$warmup" < /dev/null | grep '^M_BenchWrite'
+        run=$((run + 1))
+    done
+done
@@ -36,8 +36,9 @@
 /* Define to 1 if you have the <memory.h> header file. */
 #undef HAVE_MEMORY_H
 
-/* Define to 1 if you have the `mmap' function. */
-#undef HAVE_MMAP
+/* Define to 1 if you have the `mmap' function. The POSIX Makefiles define
+   this on the command line. */
+/* #undef HAVE_MMAP */
 
 /* Define to 1 if you have the `sched_setaffinity' function. */
 #undef HAVE_SCHED_SETAFFINITY
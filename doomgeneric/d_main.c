@@ -46,6 +46,8 @@
 #include "f_wipe.h"
 
 #include "m_argv.h"
+#include "m_bench.h"
+#include "m_profile.h"
 #include "m_config.h"
 #include "m_controls.h"
 #include "m_misc.h"
@@ -241,8 +243,15 @@ void D_Display (void)
     
     // draw the view directly
     if (gamestate == GS_LEVEL && !automapactive && gametic)
+    {
+        uint64_t start = benchmarking ? I_GetTimeNS() : 0;
+
     	R_RenderPlayerView (&players[displayplayer]);
 
+        if (benchmarking)
+            M_BenchRecord(BENCH_RENDER, I_GetTimeNS() - start);
+    }
+
     if (gamestate == GS_LEVEL && gametic)
     	HU_Drawer ();
     
@@ -404,18 +413,29 @@ boolean D_GrabMouseCallback(void)
 
 void doomgeneric_Tick()
 {
+    uint64_t start = benchmarking ? I_GetTimeNS() : 0;
+
+    PROFILE_FRAME();
+
     // frame syncronous IO operations
     I_StartFrame ();
 
     TryRunTics (); // will run at least one tic
 
+    PROFILE_BEGIN(PROF_UPDATESOUNDS);
     S_UpdateSounds (players[consoleplayer].mo);// move positional sounds
+    PROFILE_END(PROF_UPDATESOUNDS);
 
     // Update display, next frame, with current state.
     if (screenvisible)
     {
+        PROFILE_BEGIN(PROF_DISPLAY);
         D_Display ();
+        PROFILE_END(PROF_DISPLAY);
     }
+
+    if (benchmarking)
+        M_BenchRecord(BENCH_FRAME, I_GetTimeNS() - start);
 }
 
 //
@@ -1164,7 +1184,9 @@ void D_DoomMain (void)
 {
     int p;
     char file[256];
-    char demolumpname[9];
+    // This outlives D_DoomMain, because the demo code keeps a pointer
+    // to it until the demo finishes.
+    static char demolumpname[9];
 #if ORIGCODE
     int numiwadlumps;
 #endif
@@ -1793,6 +1815,9 @@ void D_DoomMain (void)
         DEH_printf("External statistics registered.\n");
     }
 
+    M_BenchInit();
+    M_ProfileInit();
+
     //!
     // @arg <x>
     // @category demo
@@ -23,6 +23,7 @@
 
 #include "d_main.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_menu.h"
 #include "m_misc.h"
 #include "i_system.h"
@@ -91,7 +92,17 @@ static void RunTic(ticcmd_t *cmds, boolean *ingame)
     if (advancedemo)
         D_DoAdvanceDemo ();
 
-    G_Ticker ();
+    if (benchmarking)
+    {
+        uint64_t start = I_GetTimeNS();
+
+        G_Ticker ();
+        M_BenchRecord(BENCH_TIC, I_GetTimeNS() - start);
+    }
+    else
+    {
+        G_Ticker ();
+    }
 }
 
 static loop_interface_t doom_loop_interface = {
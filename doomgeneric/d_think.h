@@ -60,6 +60,9 @@ typedef struct thinker_s
     struct thinker_s*	prev;
     struct thinker_s*	next;
     think_t		function;
+
+    // Order the thinker was added in, across all the thinker lists.
+    int			seq;
     
 } thinker_t;
 
@@ -0,0 +1,249 @@
+//doomgeneric for headless benchmark and regression runs
+//
+// Renders into memory only, and never actually sleeps: by default time is
+// a virtual clock that advances only when the game asks to sleep, so the
+// game runs at full CPU speed and renders exactly the same frames on every
+// run. -realclock uses the host's monotonic clock instead, for timings.
+//
+// Each frame can be reduced to a hash (-framehash) and/or written out as an
+// image (-framedump) so that runs can be compared pixel-for-pixel.
+
+#include "doomkeys.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "doomgeneric.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static boolean use_real_clock = false;
+static uint32_t virtual_ms = 1; // I_GetTime treats a zero base time as unset
+
+static uint32_t frame_num = 0;
+static uint32_t max_frames = 0;
+static FILE *hash_file = NULL;
+static char *dump_dir = NULL;
+
+// FNV-1a, which is fast and more than strong enough to detect changes
+// between runs.
+#define FNV_OFFSET_BASIS (0xcbf29ce484222325ULL)
+#define FNV_PRIME (0x100000001b3ULL)
+
+static uint64_t hash_bytes(uint64_t hash, const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+
+    while (p < end)
+    {
+        hash ^= *p++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static inline void pixel_rgb(pixel_t pixel, uint8_t *rgb)
+{
+#ifdef CMAP256
+    rgb[0] = colors[pixel].r;
+    rgb[1] = colors[pixel].g;
+    rgb[2] = colors[pixel].b;
+#else
+    rgb[0] = (pixel >> 16) & 0xff;
+    rgb[1] = (pixel >> 8) & 0xff;
+    rgb[2] = pixel & 0xff;
+#endif
+}
+
+static uint64_t frame_hash(void)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = hash_bytes(hash, (const uint8_t *) DG_ScreenBuffer,
+                      DOOMGENERIC_RESX * DOOMGENERIC_RESY * sizeof(pixel_t));
+#ifdef CMAP256
+    // Palette changes (damage and pickup flashes) don't change the
+    // buffer contents, so the palette is part of the frame too.
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t rgb[3];
+        pixel_rgb(i, rgb);
+        hash = hash_bytes(hash, rgb, sizeof(rgb));
+    }
+#endif
+    return hash;
+}
+
+static void dump_frame(void)
+{
+    char path[256];
+    FILE *f;
+    uint8_t row[DOOMGENERIC_RESX * 3];
+
+    M_snprintf(path, sizeof(path), "%s/frame%06u.ppm", dump_dir, frame_num);
+    f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        I_Error("DG_DrawFrame: failed to create %s", path);
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", DOOMGENERIC_RESX, DOOMGENERIC_RESY);
+    for (int y = 0; y < DOOMGENERIC_RESY; y++)
+    {
+        pixel_t *in = DG_ScreenBuffer + y * DOOMGENERIC_RESX;
+        for (int x = 0; x < DOOMGENERIC_RESX; x++)
+        {
+            pixel_rgb(in[x], &row[x * 3]);
+        }
+        fwrite(row, 1, sizeof(row), f);
+    }
+    fclose(f);
+}
+
+static void close_hash_file(void)
+{
+    if (hash_file != NULL && hash_file != stdout)
+    {
+        fclose(hash_file);
+    }
+    hash_file = NULL;
+}
+
+void DG_Init()
+{
+    int p;
+
+    //!
+    // @category obscure
+    //
+    // Headless only: use the host's monotonic clock rather than a virtual
+    // clock that only advances when the game would otherwise sleep.
+    //
+
+    use_real_clock = M_CheckParm("-realclock") > 0;
+
+    //!
+    // @arg <file>
+    // @category obscure
+    //
+    // Headless only: write a line with the frame number and a 64-bit hash
+    // of the screen contents to the given file ("-" for stdout) after
+    // every frame is drawn.
+    //
+
+    p = M_CheckParmWithArgs("-framehash", 1);
+    if (p)
+    {
+        if (!strcmp(myargv[p + 1], "-"))
+        {
+            hash_file = stdout;
+        }
+        else
+        {
+            hash_file = fopen(myargv[p + 1], "w");
+            if (hash_file == NULL)
+            {
+                I_Error("DG_Init: failed to create %s", myargv[p + 1]);
+            }
+        }
+        I_AtExit(close_hash_file, true);
+    }
+
+    //!
+    // @arg <dir>
+    // @category obscure
+    //
+    // Headless only: write every frame drawn into the given directory as
+    // a PPM image.
+    //
+
+    p = M_CheckParmWithArgs("-framedump", 1);
+    if (p)
+    {
+        dump_dir = myargv[p + 1];
+        M_MakeDirectory(dump_dir);
+    }
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Headless only: quit after drawing n frames.
+    //
+
+    p = M_CheckParmWithArgs("-maxframes", 1);
+    if (p)
+    {
+        max_frames = atoi(myargv[p + 1]);
+    }
+}
+
+void DG_DrawFrame()
+{
+    frame_num++;
+
+    if (hash_file != NULL)
+    {
+        fprintf(hash_file, "%06u %016llx\n", frame_num,
+                (unsigned long long) frame_hash());
+    }
+
+    if (dump_dir != NULL)
+    {
+        dump_frame();
+    }
+
+    if (max_frames != 0 && frame_num >= max_frames)
+    {
+        // I_Quit only runs the exit functions here, so we must exit
+        // ourselves.
+        I_Quit();
+        exit(0);
+    }
+}
+
+void DG_SleepMs(uint32_t ms)
+{
+    if (!use_real_clock)
+    {
+        virtual_ms += ms;
+    }
+}
+
+uint32_t DG_GetTicksMs()
+{
+    struct timespec ts;
+
+    if (!use_real_clock)
+    {
+        return virtual_ms;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+int DG_GetKey(int* pressed, unsigned char* doomKey)
+{
+    return 0;
+}
+
+void DG_SetWindowTitle(const char * title)
+{
+}
+
+int main(int argc, char **argv)
+{
+    doomgeneric_Create(argc, argv);
+
+    for (;;)
+    {
+        doomgeneric_Tick();
+    }
+
+    return 0;
+}
@@ -33,6 +33,7 @@
 #include "m_argv.h"
 #include "m_controls.h"
 #include "m_misc.h"
+#include "m_profile.h"
 #include "m_menu.h"
 #include "m_random.h"
 #include "i_system.h"
@@ -40,6 +41,7 @@
 #include "i_video.h"
 
 #include "p_setup.h"
+#include "p_prefetch.h"
 #include "p_saveg.h"
 #include "p_tick.h"
 
@@ -1005,7 +1007,9 @@ void G_Ticker (void)
     switch (gamestate) 
     { 
       case GS_LEVEL: 
+	PROFILE_BEGIN(PROF_TICKER);
 	P_Ticker (); 
+	PROFILE_END(PROF_TICKER);
 	ST_Ticker (); 
 	AM_Ticker (); 
 	HU_Ticker ();            
@@ -1013,6 +1017,7 @@ void G_Ticker (void)
 	 
       case GS_INTERMISSION: 
 	WI_Ticker (); 
+	P_PrefetchTicker ();
 	break; 
 			 
       case GS_FINALE: 
@@ -1485,6 +1490,13 @@ void G_DoCompleted (void)
     StatCopy(&wminfo);
  
     WI_Start (&wminfo); 
+
+    // Start reading in the next level, unless this was the last one.
+    if (gamemode == commercial ? gamemap != 30 : gamemap != 8)
+    {
+	P_StartPrefetch (gamemode == commercial ? 1 : wminfo.epsd + 1,
+			 wminfo.next + 1);
+    }
 } 
 
 
@@ -2149,6 +2161,15 @@ static char *DemoVersionDescription(int version)
     }
 }
 
+// Set while G_DoPlayDemo loads the demo's first level, as
+// G_InitNew clears demoplayback.
+static boolean demostarting;
+
+boolean G_DemoOrNetGame (void)
+{
+    return netgame || demoplayback || demorecording || demostarting;
+}
+
 void G_DoPlayDemo (void) 
 { 
     skill_t skill; 
@@ -2206,7 +2227,9 @@ void G_DoPlayDemo (void)
 
     // don't spend a lot of time in loadlevel 
     precache = false;
+    demostarting = true;
     G_InitNew (skill, episode, map); 
+    demostarting = false;
     precache = true; 
     starttime = I_GetTime (); 
 
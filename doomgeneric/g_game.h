@@ -57,6 +57,11 @@ void G_PlayDemo (char* name);
 void G_TimeDemo (char* name);
 boolean G_CheckDemoStatus (void);
 
+// True while a demo or netgame is running, including while the
+// demo's first level is being loaded, so options that would change
+// the playsim should be ignored.
+boolean G_DemoOrNetGame (void);
+
 void G_ExitLevel (void);
 void G_SecretExitLevel (void);
 
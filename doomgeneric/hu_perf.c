@@ -0,0 +1,300 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Heads-up performance overlay, for -perfoverlay.
+//
+//	Shows frame timings and how close the renderer and playsim are to
+//	their fixed limits, so that a map's limits can be checked on the
+//	target hardware without having to overflow them first.
+//
+
+#include <stdarg.h>
+
+#include "doomdef.h"
+#include "i_swap.h"
+#include "hu_lib.h"
+#include "hu_perf.h"
+#include "hu_stuff.h"
+#include "m_argv.h"
+#include "m_bench.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "r_local.h"
+#include "s_sound.h"
+#include "z_zone.h"
+
+// Flag a limit as nearly reached at this percentage of it.
+#define PERF_WARNPCT 90
+
+enum
+{
+    PERF_TIMES,
+    PERF_VISPLANES,
+    PERF_DRAWSEGS,
+    PERF_VISSPRITES,
+    PERF_OPENINGS,
+    PERF_THINKERS,
+    PERF_POOLS,
+    PERF_INTERCEPTS,
+    PERF_ZONE,
+    PERF_FRAG,
+#ifdef FEATURE_ZONESTATS
+    PERF_ZONESTATS,
+#endif
+    PERF_SOUND,
+
+    NUMPERFLINES
+};
+
+extern patch_t *hu_font[HU_FONTSIZE];
+
+boolean perfoverlay = false;
+
+static hu_textline_t perf_lines[NUMPERFLINES];
+
+// Highest usage of each renderer limit seen since the level started.
+static int peak_visplanes;
+static int peak_drawsegs;
+static int peak_vissprites;
+static int peak_openings;
+
+// Counts for the last tic.
+static int tic_thinkers;
+static int tic_sights;
+static int tic_sighthits;
+static int tic_sighttraces;
+static int tic_intercepts;
+static int tic_peakintercepts;
+
+static int last_sightcount;
+static int last_sighthits;
+static int last_sighttraces;
+static int last_interceptcount;
+
+#ifdef FEATURE_ZONESTATS
+static unsigned int tic_allocs;
+static unsigned int tic_purges;
+static long long tic_purgebytes;
+
+static zonestat_t last_zonestats;
+#endif
+
+static void SetLine(int line, const char *s, ...)
+{
+    hu_textline_t *l = &perf_lines[line];
+    char buf[HU_MAXLINELENGTH + 1];
+    va_list args;
+    char *c;
+
+    va_start(args, s);
+    M_vsnprintf(buf, sizeof(buf), s, args);
+    va_end(args);
+
+    HUlib_clearTextLine(l);
+    for (c = buf; *c != '\0'; ++c)
+    {
+        HUlib_addCharToTextLine(l, *c);
+    }
+}
+
+// A limited resource, with its peak since the start of the level.
+
+static void SetLimitLine(int line, const char *name, int used, int *peak,
+                         int limit)
+{
+    if (used > *peak)
+    {
+        *peak = used;
+    }
+
+    SetLine(line, "%s %d/%d PEAK %d%s", name, used, limit, *peak,
+            *peak * 100 >= limit * PERF_WARNPCT ? " !" : "");
+}
+
+void HU_PerfInit(void)
+{
+    int lh;
+    int i;
+
+    //!
+    // @category obscure
+    //
+    // Show an overlay with frame timings, renderer and playsim limits
+    // and memory and sound channel usage while playing.
+    //
+
+    perfoverlay = M_CheckParm("-perfoverlay") > 0;
+    if (!perfoverlay)
+    {
+        return;
+    }
+
+    // The frame timings come from the same place as -benchout.
+
+    benchmarking = true;
+
+    // Start below the message and chat lines.
+
+    lh = SHORT(hu_font[0]->height) + 1;
+    for (i = 0; i < NUMPERFLINES; ++i)
+    {
+        HUlib_initTextLine(&perf_lines[i], HU_MSGX,
+                           HU_MSGY + (HU_MSGHEIGHT + 1 + i) * lh,
+                           hu_font, HU_FONTSTART);
+    }
+}
+
+void HU_PerfStart(void)
+{
+    peak_visplanes = 0;
+    peak_drawsegs = 0;
+    peak_vissprites = 0;
+    peak_openings = 0;
+}
+
+void HU_PerfTicker(void)
+{
+    thinker_t *th;
+    int i;
+
+    if (!perfoverlay)
+    {
+        return;
+    }
+
+    tic_thinkers = 0;
+    for (i = 0; i < NUMTHINKERCLASSES; ++i)
+    {
+        for (th = thinkerclasscap[i].next; th != &thinkerclasscap[i];
+             th = th->next)
+        {
+            ++tic_thinkers;
+        }
+    }
+
+    tic_sights = sightcounts[0] + sightcounts[1] - last_sightcount;
+    last_sightcount = sightcounts[0] + sightcounts[1];
+
+    tic_sighthits = sightcachecounts[0] - last_sighthits;
+    tic_sighttraces = sightcachecounts[1] - last_sighttraces;
+    last_sighthits = sightcachecounts[0];
+    last_sighttraces = sightcachecounts[1];
+
+    tic_intercepts = interceptcount - last_interceptcount;
+    last_interceptcount = interceptcount;
+
+    tic_peakintercepts = peakintercepts;
+    peakintercepts = 0;
+
+#ifdef FEATURE_ZONESTATS
+    if (zonestats)
+    {
+        const zonestat_t *stat = Z_ZoneStats(0);
+
+        tic_allocs = stat->allocs - last_zonestats.allocs;
+        tic_purges = stat->purges - last_zonestats.purges;
+        tic_purgebytes = stat->purgebytes - last_zonestats.purgebytes;
+        last_zonestats = *stat;
+    }
+#endif
+}
+
+void HU_PerfDrawer(void)
+{
+    int used, free, purgeable;
+    int largest;
+    int i;
+
+    if (!perfoverlay)
+    {
+        return;
+    }
+
+    SetLine(PERF_TIMES, "FRAME %.2fMS TIC %.2fMS RENDER %.2fMS",
+            M_BenchRecent(BENCH_FRAME) / 1000000.0,
+            M_BenchRecent(BENCH_TIC) / 1000000.0,
+            M_BenchRecent(BENCH_RENDER) / 1000000.0);
+
+    // These are all still as the last R_RenderPlayerView left them.
+
+    SetLimitLine(PERF_VISPLANES, "VISPLANES", lastvisplane - visplanes,
+                 &peak_visplanes, MAXVISPLANES);
+    SetLimitLine(PERF_DRAWSEGS, "DRAWSEGS", ds_p - drawsegs,
+                 &peak_drawsegs, MAXDRAWSEGS);
+    SetLimitLine(PERF_VISSPRITES, "VISSPRITES", vissprite_p - vissprites,
+                 &peak_vissprites, MAXVISSPRITES);
+    SetLimitLine(PERF_OPENINGS, "OPENINGS", lastopening - openings,
+                 &peak_openings, MAXOPENINGS);
+
+    SetLine(PERF_THINKERS, "THINKERS %d SIGHT %d/TIC CACHED %d%%",
+            tic_thinkers, tic_sights,
+            tic_sighthits + tic_sighttraces > 0
+                ? tic_sighthits * 100 / (tic_sighthits + tic_sighttraces)
+                : 0);
+
+    // In use and allocated, for each kind of thinker.
+
+    SetLine(PERF_POOLS, "POOL MOBJ %d/%d LIGHT %d/%d MOVER %d/%d",
+            thinkerpools[th_mobj].inuse, thinkerpools[th_mobj].allocated,
+            thinkerpools[th_light].inuse, thinkerpools[th_light].allocated,
+            thinkerpools[th_mover].inuse, thinkerpools[th_mover].allocated);
+
+    // Intercepts beyond the original limit are emulating the overrun of
+    // the original table, so that is the limit that matters.
+
+    SetLine(PERF_INTERCEPTS, "INTERCEPTS %d/TIC PEAK %d/%d%s",
+            tic_intercepts, tic_peakintercepts, MAXINTERCEPTS_ORIGINAL,
+            tic_peakintercepts * 100 >= MAXINTERCEPTS_ORIGINAL * PERF_WARNPCT
+                ? " !" : "");
+
+    Z_MemoryStats(&used, &free, &purgeable);
+    SetLine(PERF_ZONE, "ZONE USED %dK FREE %dK PURGE %dK",
+            used / 1024, free / 1024, purgeable / 1024);
+
+    SetLine(PERF_FRAG, "ZONE SIZE %dK FRAG %d%% LARGEST %dK",
+            Z_ZoneSize() / 1024, Z_Fragmentation(&largest),
+            largest / 1024);
+
+#ifdef FEATURE_ZONESTATS
+    // Left empty without -zonestats.
+
+    if (zonestats)
+    {
+        SetLine(PERF_ZONESTATS, "ZONE ALLOC %u/TIC PURGE %u/TIC %lldK",
+                tic_allocs, tic_purges, tic_purgebytes / 1024);
+    }
+#endif
+
+    SetLine(PERF_SOUND, "SOUND %d/%d", S_ChannelsInUse(), snd_channels);
+
+    for (i = 0; i < NUMPERFLINES; ++i)
+    {
+        HUlib_drawTextLine(&perf_lines[i], false);
+    }
+}
+
+void HU_PerfErase(void)
+{
+    int i;
+
+    if (!perfoverlay)
+    {
+        return;
+    }
+
+    for (i = 0; i < NUMPERFLINES; ++i)
+    {
+        HUlib_eraseTextLine(&perf_lines[i]);
+    }
+}
@@ -0,0 +1,32 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Heads-up performance overlay, for -perfoverlay.
+//
+
+#ifndef __HU_PERF__
+#define __HU_PERF__
+
+#include "doomtype.h"
+
+extern boolean perfoverlay;
+
+// Called by HU_Init, HU_Start, HU_Ticker, HU_Drawer and HU_Erase.
+void HU_PerfInit(void);
+void HU_PerfStart(void);
+void HU_PerfTicker(void);
+void HU_PerfDrawer(void);
+void HU_PerfErase(void);
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "hu_stuff.h"
 #include "hu_lib.h"
+#include "hu_perf.h"
 #include "m_controls.h"
 #include "m_misc.h"
 #include "w_wad.h"
@@ -298,6 +299,7 @@ void HU_Init(void)
 	hu_font[i] = (patch_t *) W_CacheLumpName(buffer, PU_STATIC);
     }
 
+    HU_PerfInit();
 }
 
 void HU_Stop(void)
@@ -376,6 +378,8 @@ void HU_Start(void)
     for (i=0 ; i<MAXPLAYERS ; i++)
 	HUlib_initIText(&w_inputbuffer[i], 0, 0, 0, 0, &always_off);
 
+    HU_PerfStart();
+
     headsupactive = true;
 
 }
@@ -387,6 +391,7 @@ void HU_Drawer(void)
     HUlib_drawIText(&w_chat);
     if (automapactive)
 	HUlib_drawTextLine(&w_title, false);
+    HU_PerfDrawer();
 
 }
 
@@ -396,6 +401,7 @@ void HU_Erase(void)
     HUlib_eraseSText(&w_message);
     HUlib_eraseIText(&w_chat);
     HUlib_eraseTextLine(&w_title);
+    HU_PerfErase();
 
 }
 
@@ -470,6 +476,8 @@ void HU_Ticker(void)
 	}
     }
 
+    HU_PerfTicker();
+
 }
 
 #define QUEUESIZE		128
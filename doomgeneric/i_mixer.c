@@ -0,0 +1,302 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Portable software sound effect mixer.
+//
+
+#include "config.h"
+#include "doomtype.h"
+#include "i_sound.h"
+#include "i_mixer.h"
+#include "i_system.h"
+#include "m_misc.h"
+#include "w_wad.h"
+#include "deh_str.h"
+#include "z_zone.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static boolean use_sfx_prefix;
+
+struct sound_channel {
+    uintptr_t next_addr;
+    uintptr_t stop_addr;
+    sfxinfo_t *sfxinfo; // null when channel is inactive
+    int addr_shift;
+    double left_vol;
+    double right_vol;
+};
+
+static struct sound_channel sound_channels[MIXER_NUM_CHANNELS] = {0};
+
+// struct cached_sound is the type we use for sfxinfo_t.driver_data when
+// a mixer-based sound module is active.
+struct cached_sound {
+    uint8_t *samples;
+    int length;
+    int ref_count;
+    int addr_shift;
+};
+
+void I_Mixer_Init(boolean _use_sfx_prefix) {
+    use_sfx_prefix = _use_sfx_prefix;
+}
+
+static int get_sfx_lump_num(sfxinfo_t *sfx) {
+    char namebuf[9];
+    if (sfx->link != NULL) {
+        sfx = sfx->link;
+    }
+    if (use_sfx_prefix) {
+        snprintf(namebuf, sizeof(namebuf), "ds%s", DEH_String(sfx->name));
+    } else {
+        M_StringCopy(namebuf, DEH_String(sfx->name), sizeof(namebuf));
+    }
+    return W_CheckNumForName(namebuf);
+}
+
+int I_Mixer_GetSfxLumpNum(sfxinfo_t *sfx) {
+    int ret = get_sfx_lump_num(sfx);
+    if (ret == -1) {
+        I_Error("I_Mixer_GetSfxLumpNum: %s not found!", sfx->name);
+    }
+    return ret;
+}
+
+void I_Mixer_UpdateSoundParams(int handle, int vol, int sep) {
+    if (handle < 0 || handle >= MIXER_NUM_CHANNELS) {
+        return;
+    }
+    struct sound_channel *channel = &sound_channels[handle];
+
+    int left = ((254 - sep) * vol) / 127;
+    int right = ((sep) * vol) / 127;
+
+    if (left < 0) left = 0;
+    else if ( left > 255) left = 255;
+    if (right < 0) right = 0;
+    else if (right > 255) right = 255;
+
+    // NOTE: This is a little risky, because the mixer could run at any
+    // point during the following assignments. We're assuming it's okay
+    // because the panning/volume is likely to change gradually and so not
+    // a big deal if one of these changes gets observed before the other one.
+    channel->left_vol = (double)left / 255.0;
+    channel->right_vol = (double)right / 255.0;
+}
+
+static struct cached_sound *load_sound(sfxinfo_t *sfxinfo) {
+    struct cached_sound *ret = NULL;
+
+    int lumpnum = sfxinfo->lumpnum;
+    uint8_t *raw = W_CacheLumpNum(lumpnum, PU_STATIC);
+    if (raw == NULL) {
+        return NULL;
+    }
+    // After this point we must always return indirectly with "goto done"
+    // so that we'll release the cached lump data.
+
+    int raw_len = W_LumpLength(lumpnum);
+    if (raw_len < 8 || raw[0] != 0x03 || raw[1] != 0x00) {
+        // Invalid sound data
+        goto done;
+    }
+
+    int sample_rate = (raw[3] << 8) | raw[2];
+    int length = (raw[7] << 24) | (raw[6] << 16) | (raw[5] << 8) | raw[4];
+    if (length > (raw_len - 8) || length <= 48) {
+        // Length is out of bounds, so this is invalid sound data
+        goto done;
+    }
+
+    // The original sound library used by Doom always ignores the first and
+    // last 16 bytes of the data, so we'll mimic that here.
+    raw += 16;
+    length -= 32;
+
+    // We'll allocate a single block of memory that includes both our
+    // struct cached_sound and the raw sample data afterwards, just so that
+    // we have one fewer allocation to keep track of.
+    ret = malloc(sizeof(struct cached_sound) + length);
+    if (ret == NULL) {
+        goto done;
+    }
+    ret->ref_count = 0;
+    ret->samples = (uint8_t *)(&ret[1]); // points to the byte immediately after the cached_sound
+    ret->length = length;
+    memcpy(ret->samples, raw, length); // Copy the sample data into our own allocation
+
+    // We'll precalculate the address shift based on the sample rate. Shifting
+    // the address is how we handle sample rate conversions, by treating each
+    // channel's address field as a fixed point fraction with either two, one,
+    // or zero fractional parts.
+    // The mixer always uses 44100Hz, so shift of zero would represent that rate.
+    switch (sample_rate) {
+    case 11025:
+        ret->addr_shift = 2;
+        break;
+    case 22050:
+        ret->addr_shift = 1;
+        break;
+    default:
+        // We should not get here because all samples in Doom use one of the
+        // two sample rates above. Using this mixer with a custom WAD that uses
+        // different sample rates will cause an incorrect playback speed.
+        ret->addr_shift = 0;
+    }
+
+done:
+    W_ReleaseLumpNum(lumpnum);
+    return ret;
+}
+
+static boolean lock_sound(sfxinfo_t *sfxinfo) {
+    if (sfxinfo->driver_data == NULL) {
+        // This is a sample we've not seen before, so we'll need to load
+        // its sample data into memory.
+        sfxinfo->driver_data = load_sound(sfxinfo);
+        if (sfxinfo->driver_data == NULL) {
+            return false;
+        }
+    }
+
+    struct cached_sound *cached = sfxinfo->driver_data;
+    cached->ref_count++;
+    return true;
+}
+
+static void stop_sound(int handle) {
+    // Setting sfxinfo to NULL is enough to make the mixer ignore this
+    // channel entirely, until I_Mixer_StartSound writes a non-NULL
+    // pointer here again later.
+    struct sound_channel *channel = &sound_channels[handle];
+    __atomic_store_n(&channel->sfxinfo, NULL, __ATOMIC_SEQ_CST);
+}
+
+int I_Mixer_StartSound(sfxinfo_t *sfxinfo, int channel_num, int vol, int sep) {
+    // This function could be interrupted at any point by I_Mixer_MixFrames
+    // when it's called from an interrupt handler, and so we use each
+    // channel's sfxinfo pointer to represent ownership of the other fields
+    // of the channel:
+    // - when sfxinfo is null, the mixer ignores the other fields entirely
+    //   and so this function can modify them.
+    // - when sfxinfo is not null, the mixer owns all of the other fields
+    //   and so our only valid operation is to set sfxinfo to null so we can
+    //   reclaim ownership.
+    // An interrupt handler has a higher priority than this function, so this
+    // function cannot possibly interrupt the mixer in that case.
+
+    if (channel_num < 0 || channel_num >= MIXER_NUM_CHANNELS) {
+        return -1;
+    }
+
+    struct sound_channel *channel = &sound_channels[channel_num];
+    stop_sound(channel_num);
+    // If the mixer runs from here to when we store a new pointer into
+    // channel->sfxinfo then it will treat this channel as inactive, so we
+    // can safely modify its other fields.
+
+    if (!lock_sound(sfxinfo)) {
+        return -1;
+    }
+    struct cached_sound *cached = sfxinfo->driver_data;
+
+    // The following address shifting is how we implement sample rate conversion:
+    // we effectively treat the channel's address fields as fixed-point fractions
+    // so that we can stretch out samples as needed to convert to the mixer's
+    // higher sample rate.
+    channel->addr_shift = cached->addr_shift;
+    channel->next_addr = (uintptr_t)(cached->samples) << cached->addr_shift;
+    channel->stop_addr = (uintptr_t)(cached->samples + cached->length) << cached->addr_shift;
+    I_Mixer_UpdateSoundParams(channel_num, vol, sep); // sets vol_left and vol_right
+
+    // We'll now finally populate sfxinfo, which makes this channel active
+    // as far as the mixer is concerned.
+    __atomic_store_n(&channel->sfxinfo, sfxinfo, __ATOMIC_SEQ_CST);
+
+    return channel_num;
+}
+
+void I_Mixer_StopSound(int handle) {
+    stop_sound(handle);
+}
+
+boolean I_Mixer_SoundIsPlaying(int handle) {
+    if (handle < 0 || handle >= MIXER_NUM_CHANNELS) {
+        return false;
+    }
+    struct sound_channel *channel = &sound_channels[handle];
+    sfxinfo_t *existing = __atomic_load_n(&channel->sfxinfo, __ATOMIC_SEQ_CST);
+    return existing != NULL;
+}
+
+void I_Mixer_PrecacheSounds(sfxinfo_t *sounds, int num_sounds) {
+    sfxinfo_t *stop = sounds + num_sounds;
+    for (sfxinfo_t *sound = sounds; sound != stop; sound++) {
+        int lump_num = get_sfx_lump_num(sound);
+        if (lump_num < 0) {
+            continue;
+        }
+        sound->lumpnum = lump_num;
+        sound->driver_data = load_sound(sound);
+    }
+}
+
+static inline int16_t raw_sample(double s) {
+    s *= 32767.0;
+    if (s > 32767.0) {
+        s = 32767.0;
+    } else if (s < -32767.0) {
+        s = -32767.0;
+    }
+    return (int16_t)s;
+}
+
+void I_Mixer_MixFrames(struct mixer_frame *frames, int frame_count) {
+    const double sample_scale = 0.65; // Arbitrary scale factor to give some headroom for mixing
+
+    for (int fi = 0; fi < frame_count; fi++, frames++) {
+        double left = 0.0;
+        double right = 0.0;
+
+        struct sound_channel *channel = &sound_channels[0];
+        for (int ci = 0; ci < MIXER_NUM_CHANNELS; ci++, channel++) {
+            sfxinfo_t *info = __atomic_load_n(&channel->sfxinfo, __ATOMIC_SEQ_CST);
+            if (info == NULL) {
+                continue; // channel is currently inactive, so we mustn't modify it at all
+            }
+
+            uintptr_t addr = channel->next_addr++;
+            if (addr >= channel->stop_addr) {
+                // Activity on this channel is finished.
+                stop_sound(ci);
+                continue;
+            }
+
+            uint8_t *src_sample = (uint8_t *)(addr >> channel->addr_shift);
+
+            double scaled = (((double)*src_sample) - 128) * sample_scale / 127.0;
+            left += (scaled  * channel->left_vol);
+            right += (scaled  * channel->right_vol);
+        }
+
+        // TODO: Mix in a sample from the music buffer too, if any.
+
+        frames->left = raw_sample(left);
+        frames->right = raw_sample(right);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef __I_MIXER__
+#define __I_MIXER__
+
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Portable software sound effect mixer, shared by the sound modules
+//	that produce their own PCM stream rather than delegating mixing to
+//	a library.
+//
+
+#include <stdint.h>
+
+#include "doomtype.h"
+#include "i_sound.h"
+
+// The mixer always produces 16-bit signed stereo frames at this rate.
+// Doom's own sound effects use 11025Hz or 22050Hz, which convert to this
+// rate with a simple address shift.
+#define MIXER_SAMPLE_RATE (44100)
+
+#define MIXER_NUM_CHANNELS (16)
+
+struct mixer_frame {
+    int16_t left;
+    int16_t right;
+};
+
+// The channel functions below follow the sound_module_t signatures so that
+// a sound module can use them directly or wrap them with its own locking.
+//
+// Each channel's sfxinfo pointer represents ownership of its other fields:
+// while it is NULL only the game code may modify the channel, and while it
+// is non-NULL only I_Mixer_MixFrames may. This allows I_Mixer_MixFrames to
+// run from an interrupt handler without any further locking, but callers
+// that mix from another thread must serialize the calls themselves.
+
+void I_Mixer_Init(boolean use_sfx_prefix);
+int I_Mixer_GetSfxLumpNum(sfxinfo_t *sfxinfo);
+void I_Mixer_UpdateSoundParams(int handle, int vol, int sep);
+int I_Mixer_StartSound(sfxinfo_t *sfxinfo, int channel_num, int vol, int sep);
+void I_Mixer_StopSound(int handle);
+boolean I_Mixer_SoundIsPlaying(int handle);
+void I_Mixer_PrecacheSounds(sfxinfo_t *sounds, int num_sounds);
+
+// Mix the next frame_count frames of all active channels into frames,
+// advancing each channel and stopping any that reach their end.
+void I_Mixer_MixFrames(struct mixer_frame *frames, int frame_count);
+
+#endif
@@ -0,0 +1,86 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Music for the threaded PCM sound output, which does not play music yet.
+//
+
+#include "config.h"
+#include "doomtype.h"
+#include "i_sound.h"
+
+#include <stdio.h>
+
+static boolean I_PCM_InitMusic(void) {
+    printf("I_PCM_InitMusic: music is not supported by PCM output\n");
+    return true;
+}
+
+static void I_PCM_ShutdownMusic(void) {
+}
+
+static void I_PCM_SetMusicVolume(int volume) {
+}
+
+static void I_PCM_PauseSong(void) {
+}
+
+static void I_PCM_ResumeSong(void) {
+}
+
+static void *I_PCM_RegisterSong(void *data, int len) {
+    return (void *)0;
+}
+
+static void I_PCM_UnRegisterSong(void *handle) {
+}
+
+static void I_PCM_PlaySong(void *handle, boolean looping) {
+}
+
+static void I_PCM_StopSong(void) {
+}
+
+static boolean I_PCM_MusicIsPlaying(void) {
+    return false;
+}
+
+static void I_PCM_PollMusic(void) {
+}
+
+static snddevice_t music_pcm_devices[] =
+{
+    SNDDEVICE_PAS,
+    SNDDEVICE_GUS,
+    SNDDEVICE_WAVEBLASTER,
+    SNDDEVICE_SOUNDCANVAS,
+    SNDDEVICE_GENMIDI,
+    SNDDEVICE_AWE32,
+};
+
+music_module_t DG_music_module =
+{
+    music_pcm_devices,
+    arrlen(music_pcm_devices),
+    I_PCM_InitMusic,
+    I_PCM_ShutdownMusic,
+    I_PCM_SetMusicVolume,
+    I_PCM_PauseSong,
+    I_PCM_ResumeSong,
+    I_PCM_RegisterSong,
+    I_PCM_UnRegisterSong,
+    I_PCM_PlaySong,
+    I_PCM_StopSong,
+    I_PCM_MusicIsPlaying,
+    I_PCM_PollMusic,
+};
@@ -0,0 +1,349 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Threaded software-mixed sound output for hosts without a sound
+//	device, writing PCM to a WAV file, a pipe, or nowhere at all.
+//
+
+#include "config.h"
+#include "doomtype.h"
+#include "i_sound.h"
+#include "i_mixer.h"
+#include "m_argv.h"
+#include "m_misc.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The mixer thread produces audio in periods of this many frames, which
+// is about 11.6ms at the mixer's sample rate.
+#define PERIOD_FRAMES (512)
+
+#define MAX_PERIODS (64)
+
+enum pcm_sink_type {
+    PCM_SINK_NULL,
+    PCM_SINK_RAW,
+    PCM_SINK_WAV,
+    PCM_SINK_PIPE,
+};
+
+static enum pcm_sink_type sink_type = PCM_SINK_NULL;
+static FILE *sink_file = NULL;
+static uint64_t sink_bytes = 0;
+
+// The ring holds ring_periods periods of mixed audio that have not yet been
+// written to the sink. It is filled with silence at startup and thereafter
+// the mixer thread writes out the oldest period and mixes a new one in its
+// place on each wakeup, so a sound started by the game always reaches the
+// sink a fixed ring_periods periods after it was started.
+static struct mixer_frame ring[MAX_PERIODS][PERIOD_FRAMES];
+static int ring_periods;
+static int ring_next;
+
+// mixer_lock serializes the game's channel updates with the mixer thread,
+// since unlike an interrupt handler the thread can be preempted part way
+// through mixing a channel.
+static pthread_mutex_t mixer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t mixer_thread;
+static volatile boolean mixer_running = false;
+
+// Counters reported at shutdown, for judging the cost of mixing.
+static uint64_t stat_periods = 0;
+static uint64_t stat_mix_ns = 0;
+static uint64_t stat_late_periods = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void write_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void write_le32(uint8_t *p, uint32_t v) {
+    write_le16(p, v & 0xffff);
+    write_le16(p + 2, v >> 16);
+}
+
+static void write_wav_header(uint32_t data_bytes) {
+    uint8_t header[44];
+
+    memcpy(header, "RIFF", 4);
+    write_le32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    write_le32(header + 16, 16);                        // fmt chunk size
+    write_le16(header + 20, 1);                         // PCM
+    write_le16(header + 22, 2);                         // stereo
+    write_le32(header + 24, MIXER_SAMPLE_RATE);
+    write_le32(header + 28, MIXER_SAMPLE_RATE * 4);     // bytes per second
+    write_le16(header + 32, 4);                         // bytes per frame
+    write_le16(header + 34, 16);                        // bits per sample
+    memcpy(header + 36, "data", 4);
+    write_le32(header + 40, data_bytes);
+
+    fwrite(header, 1, sizeof(header), sink_file);
+}
+
+static boolean open_sink(void) {
+    int p;
+
+    //!
+    // @arg <target>
+    //
+    // Write the mixed sound effect output to the given target instead of
+    // discarding it. A target ending in ".wav" is written as a WAV file,
+    // a target starting with "|" is run as a shell command that receives
+    // the audio on its standard input, and anything else is written as
+    // raw 16-bit little-endian stereo PCM.
+    //
+
+    p = M_CheckParmWithArgs("-pcmout", 1);
+    if (!p) {
+        sink_type = PCM_SINK_NULL;
+        return true;
+    }
+
+    char *target = myargv[p + 1];
+    if (target[0] == '|') {
+        // If the command exits early we want the write to fail with
+        // EPIPE so that write_period can stop, rather than the signal
+        // killing the game.
+        signal(SIGPIPE, SIG_IGN);
+        sink_type = PCM_SINK_PIPE;
+        sink_file = popen(target + 1, "w");
+    } else if (M_StringEndsWith(target, ".wav") || M_StringEndsWith(target, ".WAV")) {
+        sink_type = PCM_SINK_WAV;
+        sink_file = fopen(target, "wb");
+    } else {
+        sink_type = PCM_SINK_RAW;
+        sink_file = fopen(target, "wb");
+    }
+
+    if (sink_file == NULL) {
+        printf("I_PCM_InitSound: failed to open %s: %s\n", target, strerror(errno));
+        sink_type = PCM_SINK_NULL;
+        return false;
+    }
+
+    if (sink_type == PCM_SINK_WAV) {
+        // The sizes are not known yet, so we'll rewrite this at shutdown.
+        write_wav_header(0);
+    }
+    return true;
+}
+
+static void close_sink(void) {
+    switch (sink_type) {
+    case PCM_SINK_WAV:
+        if (sink_bytes > 0xffffffffULL - 36) {
+            sink_bytes = 0xffffffffULL - 36;
+        }
+        fseek(sink_file, 0, SEEK_SET);
+        write_wav_header((uint32_t)sink_bytes);
+        fclose(sink_file);
+        break;
+    case PCM_SINK_PIPE:
+        pclose(sink_file);
+        break;
+    case PCM_SINK_RAW:
+        fclose(sink_file);
+        break;
+    case PCM_SINK_NULL:
+        break;
+    }
+    sink_file = NULL;
+}
+
+static void write_period(struct mixer_frame *frames) {
+    if (sink_file == NULL) {
+        return;
+    }
+
+    // The sinks are all little-endian, as is the mixer's output on all of
+    // the hosts this module is intended for.
+    size_t written = fwrite(frames, sizeof(struct mixer_frame), PERIOD_FRAMES, sink_file);
+    sink_bytes += written * sizeof(struct mixer_frame);
+    if (written != PERIOD_FRAMES) {
+        // The reader went away, so we'll just stop writing.
+        printf("I_PCM: sound output stopped: %s\n", strerror(errno));
+        close_sink();
+        sink_type = PCM_SINK_NULL;
+    }
+}
+
+static void *mixer_thread_main(void *arg) {
+    const uint64_t period_ns = (uint64_t)PERIOD_FRAMES * 1000000000ULL / MIXER_SAMPLE_RATE;
+    uint64_t deadline = now_ns();
+
+    while (mixer_running) {
+        struct mixer_frame *slot = ring[ring_next];
+
+        write_period(slot);
+
+        uint64_t start = now_ns();
+        pthread_mutex_lock(&mixer_lock);
+        I_Mixer_MixFrames(slot, PERIOD_FRAMES);
+        pthread_mutex_unlock(&mixer_lock);
+        uint64_t end = now_ns();
+
+        stat_mix_ns += end - start;
+        stat_periods++;
+        ring_next = (ring_next + 1) % ring_periods;
+
+        deadline += period_ns;
+        if (end > deadline) {
+            // We're running behind, so we'll produce the next period
+            // immediately to catch up, keeping the output continuous.
+            stat_late_periods++;
+            continue;
+        }
+
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000000000ULL;
+        ts.tv_nsec = deadline % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+
+    return NULL;
+}
+
+static boolean I_PCM_InitSound(boolean use_sfx_prefix) {
+    int p;
+    int latency_ms = 46;
+
+    //!
+    // @arg <ms>
+    //
+    // Fixed latency between a sound effect starting and its audio reaching
+    // the -pcmout target, in milliseconds. The default is 46.
+    //
+
+    p = M_CheckParmWithArgs("-pcmlatency", 1);
+    if (p) {
+        latency_ms = atoi(myargv[p + 1]);
+    }
+
+    ring_periods = (latency_ms * MIXER_SAMPLE_RATE + (PERIOD_FRAMES * 1000 - 1)) / (PERIOD_FRAMES * 1000);
+    if (ring_periods < 1) {
+        ring_periods = 1;
+    } else if (ring_periods > MAX_PERIODS) {
+        ring_periods = MAX_PERIODS;
+    }
+    ring_next = 0;
+    memset(ring, 0, sizeof(ring));
+
+    if (!open_sink()) {
+        return false;
+    }
+
+    I_Mixer_Init(use_sfx_prefix);
+
+    mixer_running = true;
+    if (pthread_create(&mixer_thread, NULL, mixer_thread_main, NULL) != 0) {
+        printf("I_PCM_InitSound: failed to start mixer thread\n");
+        mixer_running = false;
+        close_sink();
+        return false;
+    }
+
+    printf("I_PCM_InitSound: mixing %dHz stereo with %d periods (%dms) latency\n",
+           MIXER_SAMPLE_RATE, ring_periods,
+           ring_periods * PERIOD_FRAMES * 1000 / MIXER_SAMPLE_RATE);
+    return true;
+}
+
+static void I_PCM_ShutdownSound(void) {
+    if (!mixer_running) {
+        return;
+    }
+    mixer_running = false;
+    pthread_join(mixer_thread, NULL);
+    close_sink();
+
+    if (stat_periods > 0) {
+        uint64_t audio_ns = stat_periods * PERIOD_FRAMES * 1000000000ULL / MIXER_SAMPLE_RATE;
+        printf("I_PCM_ShutdownSound: mixed %llu periods in %llu us (%.3f%% of realtime), %llu late\n",
+               (unsigned long long)stat_periods,
+               (unsigned long long)(stat_mix_ns / 1000),
+               100.0 * (double)stat_mix_ns / (double)audio_ns,
+               (unsigned long long)stat_late_periods);
+    }
+}
+
+static void I_PCM_UpdateSound(void) {
+    // The mixer thread deals with the periodic updates.
+}
+
+static void I_PCM_UpdateSoundParams(int handle, int vol, int sep) {
+    pthread_mutex_lock(&mixer_lock);
+    I_Mixer_UpdateSoundParams(handle, vol, sep);
+    pthread_mutex_unlock(&mixer_lock);
+}
+
+static int I_PCM_StartSound(sfxinfo_t *sfxinfo, int channel_num, int vol, int sep) {
+    int ret;
+
+    pthread_mutex_lock(&mixer_lock);
+    ret = I_Mixer_StartSound(sfxinfo, channel_num, vol, sep);
+    pthread_mutex_unlock(&mixer_lock);
+    return ret;
+}
+
+static void I_PCM_StopSound(int handle) {
+    pthread_mutex_lock(&mixer_lock);
+    I_Mixer_StopSound(handle);
+    pthread_mutex_unlock(&mixer_lock);
+}
+
+static void I_PCM_PrecacheSounds(sfxinfo_t *sounds, int num_sounds) {
+    pthread_mutex_lock(&mixer_lock);
+    I_Mixer_PrecacheSounds(sounds, num_sounds);
+    pthread_mutex_unlock(&mixer_lock);
+}
+
+static snddevice_t sound_pcm_devices[] =
+{
+    SNDDEVICE_SB,
+    SNDDEVICE_PAS,
+    SNDDEVICE_GUS,
+    SNDDEVICE_WAVEBLASTER,
+    SNDDEVICE_SOUNDCANVAS,
+    SNDDEVICE_AWE32,
+};
+
+sound_module_t DG_sound_module =
+{
+    sound_pcm_devices,
+    arrlen(sound_pcm_devices),
+    I_PCM_InitSound,
+    I_PCM_ShutdownSound,
+    I_Mixer_GetSfxLumpNum,
+    I_PCM_UpdateSound,
+    I_PCM_UpdateSoundParams,
+    I_PCM_StartSound,
+    I_PCM_StopSound,
+    I_Mixer_SoundIsPlaying,
+    I_PCM_PrecacheSounds,
+};
@@ -130,6 +130,11 @@ static byte *AutoAllocMemory(int *size, int default_ram, int min_ram)
     return zonemem;
 }
 
+// Total size of the zone's regions, and the most it may grow to.
+
+static long long zone_total;
+static long long zone_max;
+
 byte *I_ZoneBase (int *size)
 {
     byte *zonemem;
@@ -160,9 +165,70 @@ byte *I_ZoneBase (int *size)
     printf("zone memory: %p, %x allocated for zone\n", 
            zonemem, *size);
 
+    zone_total = *size;
+
+    //!
+    // @arg <mb>
+    //
+    // Let the zone grow to at most this many MiB when it runs out of
+    // memory. By default it grows for as long as more memory can be
+    // allocated. Give the same size as -mb to keep it from growing.
+    //
+
+    p = M_CheckParmWithArgs("-mbmax", 1);
+
+    if (p > 0)
+    {
+        zone_max = (long long) atoi(myargv[p+1]) * 1024 * 1024;
+    }
+    else
+    {
+        zone_max = INT_MAX;
+    }
+
     return zonemem;
 }
 
+//
+// Allocate another region for the zone, of at least *size bytes, when
+// it has run out of memory. Regions are a whole number of MiB, and
+// *size is set to the size allocated. Returns NULL if that would take
+// the zone past -mbmax, or the memory can't be allocated.
+//
+
+byte *I_ZoneExtend(int *size)
+{
+    long long region_size;
+    byte *region;
+
+    region_size = ((long long) *size + 0xfffff) & ~0xfffffLL;
+
+    if (zone_total + region_size > zone_max)
+    {
+        return NULL;
+    }
+
+    region = malloc(region_size);
+
+    if (region == NULL)
+    {
+        return NULL;
+    }
+
+    zone_total += region_size;
+    *size = region_size;
+
+    return region;
+}
+
+// Give a region added by I_ZoneExtend back to the system.
+
+void I_ZoneRelease(byte *region, int size)
+{
+    zone_total -= size;
+    free(region);
+}
+
 void I_PrintBanner(char *msg)
 {
     int i;
@@ -34,6 +34,11 @@ void I_Init (void);
 // for the zone management.
 byte*	I_ZoneBase (int *size);
 
+// Called by Z_Malloc when the zone is full, and by Z_FreeTags to
+// release regions that are empty again.
+byte*	I_ZoneExtend (int *size);
+void	I_ZoneRelease (byte *region, int size);
+
 boolean I_ConsoleStdout(void);
 
 
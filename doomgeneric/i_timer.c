@@ -23,6 +23,12 @@
 
 #include <stdarg.h>
 
+#if defined(RISCOVITE)
+#include <riscovite.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
 //#include <sys/time.h>
 //#include <unistd.h>
 
@@ -71,6 +77,33 @@ int I_GetTimeMS(void)
     return ticks - basetime;
 }
 
+//
+// Same as I_GetTime, but returns time in nanoseconds, for measuring how
+// long things take rather than for timing the game. This deliberately
+// bypasses DG_GetTicksMs, which may be a virtual clock.
+//
+
+uint64_t I_GetTimeNS(void)
+{
+#if defined(RISCOVITE)
+    struct riscovite_result_uint64 r_u64 = riscovite_get_current_timestamp();
+
+    if (r_u64.error == 0)
+    {
+        return r_u64.value;
+    }
+#elif defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    {
+        return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+#endif
+
+    return (uint64_t) DG_GetTicksMs() * 1000000ULL;
+}
+
 // Sleep for a specified number of ms
 
 void I_Sleep(int ms)
@@ -20,6 +20,8 @@
 #ifndef __I_TIMER__
 #define __I_TIMER__
 
+#include <stdint.h>
+
 #define TICRATE 35
 
 // Called by D_DoomLoop,
@@ -29,6 +31,10 @@ int I_GetTime (void);
 // returns current time in ms
 int I_GetTimeMS (void);
 
+// returns current time in ns, from the most precise clock available.
+// Only differences between two values are meaningful.
+uint64_t I_GetTimeNS (void);
+
 // Pause for a specified number of ms
 void I_Sleep(int ms);
 
@@ -28,6 +28,7 @@ rcsid[] = "$Id: i_x.c,v 1.6 1997/02/03 22:45:10 b1 Exp $";
 #include "config.h"
 #include "v_video.h"
 #include "m_argv.h"
+#include "m_profile.h"
 #include "d_event.h"
 #include "d_main.h"
 #include "i_video.h"
@@ -269,6 +270,8 @@ void I_FinishUpdate (void)
     int x_offset, y_offset, x_offset_end;
     unsigned char *line_in, *line_out;
 
+    PROFILE_BEGIN(PROF_FINISHUPDATE);
+
     /* Offsets in case FB is bigger than DOOM */
     /* 600 = s_Fb heigt, 200 screenheight */
     /* 600 = s_Fb heigt, 200 screenheight */
@@ -311,7 +314,11 @@ void I_FinishUpdate (void)
         line_in += SCREENWIDTH;
     }
 
+	PROFILE_BEGIN(PROF_DRAWFRAME);
 	DG_DrawFrame();
+	PROFILE_END(PROF_DRAWFRAME);
+
+	PROFILE_END(PROF_FINISHUPDATE);
 }
 
 //
@@ -0,0 +1,335 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Benchmark timing capture, for -benchout.
+//
+//	Every frame, tic and view render is timed individually and kept
+//	until exit, when the distribution of each is summarized and appended
+//	to the output file so that repeated runs of the same demo can be
+//	compared statistically.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_loop.h"
+#include "d_main.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_bench.h"
+#include "m_misc.h"
+
+boolean benchmarking = false;
+
+typedef struct
+{
+    uint32_t *samples;
+    int numsamples;
+    int maxsamples;
+} benchseries_t;
+
+typedef struct
+{
+    int count;
+    double mean;
+    double p50, p95, p99, max;
+} benchsummary_t;
+
+static const char *metric_names[NUMBENCHMETRICS] =
+{
+    "frame",
+    "tic",
+    "render",
+};
+
+static benchseries_t series[NUMBENCHMETRICS];
+static uint64_t recent[NUMBENCHMETRICS];
+
+static char *bench_filename;
+static char *bench_label = "";
+static char *bench_demo = "";
+static int bench_warmup = 35;
+
+void M_BenchRecord(benchmetric_t metric, uint64_t ns)
+{
+    benchseries_t *s = &series[metric];
+
+    // Weight the newest sample by 1/16, which averages over roughly the
+    // last half second at 35 frames per second.
+
+    recent[metric] = recent[metric] - recent[metric] / 16 + ns / 16;
+
+    // Level startup is dominated by loading and caching, which is not
+    // what a benchmark run is trying to measure.
+
+    if (bench_filename == NULL || gametic < bench_warmup)
+    {
+        return;
+    }
+
+    if (s->numsamples == s->maxsamples)
+    {
+        s->maxsamples = s->maxsamples ? s->maxsamples * 2 : 4096;
+        s->samples = realloc(s->samples, s->maxsamples * sizeof(*s->samples));
+        if (s->samples == NULL)
+        {
+            I_Error("M_BenchRecord: out of memory");
+        }
+    }
+
+    if (ns > UINT32_MAX)
+    {
+        ns = UINT32_MAX;
+    }
+    s->samples[s->numsamples++] = (uint32_t) ns;
+}
+
+uint64_t M_BenchRecent(benchmetric_t metric)
+{
+    return recent[metric];
+}
+
+static int CompareSamples(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the sorted samples, in milliseconds.
+
+static double Percentile(benchseries_t *s, int pct)
+{
+    int rank = (s->numsamples * pct + 99) / 100;
+
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    return s->samples[rank - 1] / 1000000.0;
+}
+
+static void Summarize(benchseries_t *s, benchsummary_t *summary)
+{
+    uint64_t total = 0;
+    int i;
+
+    memset(summary, 0, sizeof(*summary));
+    if (s->numsamples == 0)
+    {
+        return;
+    }
+
+    qsort(s->samples, s->numsamples, sizeof(*s->samples), CompareSamples);
+
+    for (i = 0; i < s->numsamples; ++i)
+    {
+        total += s->samples[i];
+    }
+
+    summary->count = s->numsamples;
+    summary->mean = (double) total / s->numsamples / 1000000.0;
+    summary->p50 = Percentile(s, 50);
+    summary->p95 = Percentile(s, 95);
+    summary->p99 = Percentile(s, 99);
+    summary->max = s->samples[s->numsamples - 1] / 1000000.0;
+}
+
+// Write a string as a JSON string literal, or as a CSV field.  Neither
+// needs anything more than quoting and doubling or escaping quotes for
+// the file names and labels we deal with here.
+
+static void WriteQuoted(FILE *f, const char *str, boolean json)
+{
+    fputc('"', f);
+    for (; *str != '\0'; ++str)
+    {
+        if (*str == '"')
+        {
+            fputs(json ? "\\\"" : "\"\"", f);
+        }
+        else if (*str == '\\' && json)
+        {
+            fputs("\\\\", f);
+        }
+        else
+        {
+            fputc(*str, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void WriteJSON(FILE *f, benchsummary_t *summaries)
+{
+    int i;
+
+    fputs("{\"label\":", f);
+    WriteQuoted(f, bench_label, true);
+    fputs(",\"iwad\":", f);
+    WriteQuoted(f, iwadfile != NULL ? iwadfile : "", true);
+    fputs(",\"demo\":", f);
+    WriteQuoted(f, bench_demo, true);
+    fprintf(f, ",\"gametics\":%d,\"warmup\":%d", gametic, bench_warmup);
+
+    for (i = 0; i < NUMBENCHMETRICS; ++i)
+    {
+        benchsummary_t *m = &summaries[i];
+
+        fprintf(f, ",\"%s\":{\"count\":%d,\"mean_ms\":%.4f,\"p50_ms\":%.4f,"
+                   "\"p95_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f}",
+                metric_names[i], m->count, m->mean,
+                m->p50, m->p95, m->p99, m->max);
+    }
+    fputs("}\n", f);
+}
+
+static void WriteCSV(FILE *f, benchsummary_t *summaries)
+{
+    int i;
+
+    // Only a new file gets the header, so that repeated runs can all
+    // append to the same file.
+
+    if (ftell(f) == 0)
+    {
+        fputs("label,iwad,demo,gametics,warmup,metric,count,"
+              "mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n", f);
+    }
+
+    for (i = 0; i < NUMBENCHMETRICS; ++i)
+    {
+        benchsummary_t *m = &summaries[i];
+
+        WriteQuoted(f, bench_label, false);
+        fputc(',', f);
+        WriteQuoted(f, iwadfile != NULL ? iwadfile : "", false);
+        fputc(',', f);
+        WriteQuoted(f, bench_demo, false);
+        fprintf(f, ",%d,%d,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                gametic, bench_warmup, metric_names[i], m->count,
+                m->mean, m->p50, m->p95, m->p99, m->max);
+    }
+}
+
+static void M_BenchWrite(void)
+{
+    benchsummary_t summaries[NUMBENCHMETRICS];
+    FILE *f;
+    int i;
+
+    if (bench_filename == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < NUMBENCHMETRICS; ++i)
+    {
+        Summarize(&series[i], &summaries[i]);
+        printf("M_BenchWrite: %-6s n=%-6d mean=%.3fms p50=%.3fms "
+               "p95=%.3fms p99=%.3fms max=%.3fms\n",
+               metric_names[i], summaries[i].count, summaries[i].mean,
+               summaries[i].p50, summaries[i].p95, summaries[i].p99,
+               summaries[i].max);
+    }
+
+    f = fopen(bench_filename, "a");
+    if (f == NULL)
+    {
+        fprintf(stderr, "M_BenchWrite: failed to open %s\n", bench_filename);
+    }
+    else
+    {
+        if (M_StringEndsWith(bench_filename, ".json"))
+        {
+            WriteJSON(f, summaries);
+        }
+        else
+        {
+            WriteCSV(f, summaries);
+        }
+
+        fclose(f);
+    }
+
+    // Only write once, even if we get here again through I_Error.
+
+    bench_filename = NULL;
+}
+
+void M_BenchInit(void)
+{
+    int p;
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // Time every frame, tic and view render, and on exit append a
+    // summary of each (mean, median, 95th and 99th percentile and
+    // maximum) to the given file. If the file name ends in ".json" one
+    // JSON object is written per run, otherwise CSV rows are written.
+    // Usually combined with -timedemo.
+    //
+
+    p = M_CheckParmWithArgs("-benchout", 1);
+    if (!p)
+    {
+        return;
+    }
+    bench_filename = myargv[p + 1];
+
+    //!
+    // @arg <label>
+    // @category demo
+    //
+    // Label recorded with the -benchout results, for example to
+    // identify the build being measured.
+    //
+
+    p = M_CheckParmWithArgs("-benchlabel", 1);
+    if (p)
+    {
+        bench_label = myargv[p + 1];
+    }
+
+    //!
+    // @arg <tics>
+    // @category demo
+    //
+    // Number of gametics to run before -benchout starts recording.
+    // The default is 35.
+    //
+
+    p = M_CheckParmWithArgs("-benchwarmup", 1);
+    if (p)
+    {
+        bench_warmup = atoi(myargv[p + 1]);
+    }
+
+    p = M_CheckParmWithArgs("-timedemo", 1);
+    if (!p)
+    {
+        p = M_CheckParmWithArgs("-playdemo", 1);
+    }
+    if (p)
+    {
+        bench_demo = myargv[p + 1];
+    }
+
+    benchmarking = true;
+    I_AtExit(M_BenchWrite, true);
+}
@@ -0,0 +1,48 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Benchmark timing capture, for -benchout.
+//
+
+#ifndef __M_BENCH__
+#define __M_BENCH__
+
+#include <stdint.h>
+
+#include "doomtype.h"
+
+typedef enum
+{
+    BENCH_FRAME,        // one whole doomgeneric_Tick
+    BENCH_TIC,          // one G_Ticker
+    BENCH_RENDER,       // one R_RenderPlayerView
+
+    NUMBENCHMETRICS
+} benchmetric_t;
+
+// True when timings are being taken, for -benchout or the performance
+// overlay, so callers can skip reading the clock entirely otherwise.
+extern boolean benchmarking;
+
+void M_BenchInit(void);
+
+// Record one sample of the given metric, which took ns nanoseconds as
+// measured by I_GetTimeNS.
+void M_BenchRecord(benchmetric_t metric, uint64_t ns);
+
+// Moving average of the recent samples of the given metric, in
+// nanoseconds.
+uint64_t M_BenchRecent(benchmetric_t metric);
+
+#endif
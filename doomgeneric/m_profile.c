@@ -0,0 +1,358 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Hierarchical profiler for the engine's hot paths, for -profile.
+//
+//	Time spent in each zone is accumulated for the whole run, separately
+//	for each zone it was nested inside, which gives the flat profile.
+//	Individual zone timings are also kept for the most recent frames in
+//	a ring buffer, which gives the trace.
+//
+
+#ifdef FEATURE_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef RISCOVITE
+#include <riscovite.h>
+#endif
+
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_profile.h"
+
+// Number of frames kept for the trace, and the number of zone timings
+// that can be kept for each of them. P_CheckSight can be called hundreds
+// of times in one tic, and several tics can run in one frame, so any
+// beyond this are counted but not kept.
+#define PROFILE_FRAMES 64
+#define PROFILE_FRAME_EVENTS 2048
+
+#define PROFILE_MAX_DEPTH 16
+
+boolean profiling = false;
+
+static const char *zone_names[NUMPROFZONES] =
+{
+    "D_Display",
+    "R_RenderBSPNode",
+    "R_DrawPlanes",
+    "R_DrawMasked",
+    "I_FinishUpdate",
+    "DG_DrawFrame",
+    "P_Ticker",
+    "P_RunThinkers",
+    "P_CheckSight",
+    "S_UpdateSounds",
+};
+
+// One completed zone in the trace. Times are relative to the start of
+// the frame, so they fit in 32 bits.
+typedef struct
+{
+    uint32_t start;
+    uint32_t duration;
+    byte zone;
+    byte depth;
+} profevent_t;
+
+typedef struct
+{
+    uint64_t start;
+    unsigned int number;
+    int numevents;
+    int dropped;
+    profevent_t *events;
+} profframe_t;
+
+typedef struct
+{
+    profzone_t zone;
+    uint64_t start;
+    uint64_t child_ns;
+} profopen_t;
+
+// Totals for a zone entered while the given zone was the innermost open
+// one; the parent is NUMPROFZONES at the top level.
+typedef struct
+{
+    unsigned int calls;
+    uint64_t total_ns;
+    uint64_t self_ns;
+} profstat_t;
+
+static profstat_t stats[NUMPROFZONES + 1][NUMPROFZONES];
+
+static profopen_t stack[PROFILE_MAX_DEPTH];
+static int depth;
+
+static profframe_t frames[PROFILE_FRAMES];
+static profframe_t *frame;
+static unsigned int numframes;
+
+static char *profile_filename;
+
+static inline uint64_t ProfileNow(void)
+{
+#ifdef RISCOVITE
+    // Skip I_GetTimeNS's fallback handling, since this is called far
+    // more often.
+    return riscovite_get_current_timestamp().value;
+#else
+    return I_GetTimeNS();
+#endif
+}
+
+void M_ProfileFrame(void)
+{
+    uint64_t now = ProfileNow();
+
+    frame = &frames[numframes % PROFILE_FRAMES];
+    frame->start = now;
+    frame->number = numframes;
+    frame->numevents = 0;
+    frame->dropped = 0;
+    ++numframes;
+}
+
+void M_ProfileBegin(profzone_t zone)
+{
+    if (depth == PROFILE_MAX_DEPTH)
+    {
+        I_Error("M_ProfileBegin: %s nested too deeply", zone_names[zone]);
+    }
+
+    stack[depth].zone = zone;
+    stack[depth].child_ns = 0;
+    ++depth;
+
+    // Read the clock last, so that the bookkeeping above isn't counted.
+    stack[depth - 1].start = ProfileNow();
+}
+
+void M_ProfileEnd(profzone_t zone)
+{
+    uint64_t now = ProfileNow();
+    profopen_t *open;
+    profstat_t *stat;
+    uint64_t duration;
+    int parent;
+
+    if (depth == 0 || stack[depth - 1].zone != zone)
+    {
+        I_Error("M_ProfileEnd: %s was not the innermost open zone",
+                zone_names[zone]);
+    }
+
+    --depth;
+    open = &stack[depth];
+    duration = now - open->start;
+    parent = depth > 0 ? stack[depth - 1].zone : NUMPROFZONES;
+
+    stat = &stats[parent][zone];
+    ++stat->calls;
+    stat->total_ns += duration;
+    stat->self_ns += duration - open->child_ns;
+
+    if (depth > 0)
+    {
+        stack[depth - 1].child_ns += duration;
+    }
+
+    // Zones before the first frame (during startup) only go in the
+    // totals.
+
+    if (frame != NULL)
+    {
+        if (frame->numevents < PROFILE_FRAME_EVENTS && open->start >= frame->start)
+        {
+            profevent_t *ev = &frame->events[frame->numevents++];
+
+            ev->start = (uint32_t) (open->start - frame->start);
+            ev->duration = duration > UINT32_MAX ? UINT32_MAX : (uint32_t) duration;
+            ev->zone = zone;
+            ev->depth = depth;
+        }
+        else
+        {
+            ++frame->dropped;
+        }
+    }
+}
+
+// Chrome's trace event format, which chrome://tracing and Perfetto can
+// open, with one track showing the frames and the zones nested in them.
+
+static void WriteTrace(FILE *f)
+{
+    unsigned int first, n;
+    uint64_t base;
+    boolean comma = false;
+    int i;
+
+    first = numframes > PROFILE_FRAMES ? numframes - PROFILE_FRAMES : 0;
+    base = frames[first % PROFILE_FRAMES].start;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+
+    for (n = first; n < numframes; ++n)
+    {
+        profframe_t *fr = &frames[n % PROFILE_FRAMES];
+        double start = (fr->start - base) / 1000.0;
+
+        // The last frame is still in progress, so it has no end.
+
+        if (n + 1 < numframes)
+        {
+            uint64_t end = frames[(n + 1) % PROFILE_FRAMES].start;
+
+            fprintf(f, "%s{\"name\":\"frame %u\",\"ph\":\"X\",\"pid\":1,"
+                       "\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                       "\"args\":{\"dropped\":%d}}",
+                    comma ? ",\n" : "", fr->number, start,
+                    (end - fr->start) / 1000.0, fr->dropped);
+            comma = true;
+        }
+
+        for (i = 0; i < fr->numevents; ++i)
+        {
+            profevent_t *ev = &fr->events[i];
+
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                       "\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                    comma ? ",\n" : "", zone_names[ev->zone],
+                    start + ev->start / 1000.0, ev->duration / 1000.0);
+            comma = true;
+        }
+    }
+
+    fputs("\n]}\n", f);
+}
+
+static void WriteFlatZones(FILE *f, int parent, int indent)
+{
+    int zone;
+
+    for (zone = 0; zone < NUMPROFZONES; ++zone)
+    {
+        profstat_t *stat = &stats[parent][zone];
+
+        if (stat->calls == 0)
+        {
+            continue;
+        }
+
+        fprintf(f, "%*s%-*s %10u %12.3f %12.3f %10.4f %10.4f\n",
+                indent, "", 24 - indent, zone_names[zone], stat->calls,
+                stat->total_ns / 1000000.0, stat->self_ns / 1000000.0,
+                stat->total_ns / 1000000.0 / numframes,
+                stat->total_ns / 1000000.0 / stat->calls);
+
+        // Zones don't nest inside themselves, so this can only go as
+        // deep as the number of zones.
+
+        if (indent < NUMPROFZONES * 2)
+        {
+            WriteFlatZones(f, zone, indent + 2);
+        }
+    }
+}
+
+static void WriteFlat(FILE *f)
+{
+    fprintf(f, "%u frames\n\n", numframes);
+    fprintf(f, "%-24s %10s %12s %12s %10s %10s\n",
+            "zone", "calls", "total ms", "self ms", "ms/frame", "ms/call");
+    WriteFlatZones(f, NUMPROFZONES, 0);
+}
+
+static void M_ProfileWrite(void)
+{
+    FILE *f;
+
+    if (!profiling)
+    {
+        return;
+    }
+
+    profiling = false;
+
+    if (numframes == 0)
+    {
+        return;
+    }
+
+    f = fopen(profile_filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "M_ProfileWrite: failed to open %s\n",
+                profile_filename);
+        return;
+    }
+
+    if (M_StringEndsWith(profile_filename, ".json"))
+    {
+        WriteTrace(f);
+    }
+    else
+    {
+        WriteFlat(f);
+    }
+
+    fclose(f);
+    printf("M_ProfileWrite: wrote %s\n", profile_filename);
+}
+
+void M_ProfileInit(void)
+{
+    int p;
+    int i;
+
+    //!
+    // @arg <file>
+    // @category obscure
+    //
+    // Profile the engine's main hot paths, and on exit write the results
+    // to the given file. If the file name ends in ".json" a trace of the
+    // last 64 frames is written in Chrome's trace event format; otherwise
+    // a flat profile of the whole run is written as text. Only available
+    // in builds with FEATURE_PROFILE.
+    //
+
+    p = M_CheckParmWithArgs("-profile", 1);
+    if (!p)
+    {
+        return;
+    }
+    profile_filename = myargv[p + 1];
+
+    for (i = 0; i < PROFILE_FRAMES; ++i)
+    {
+        frames[i].events = malloc(PROFILE_FRAME_EVENTS * sizeof(profevent_t));
+        if (frames[i].events == NULL)
+        {
+            I_Error("M_ProfileInit: out of memory");
+        }
+    }
+
+    profiling = true;
+    I_AtExit(M_ProfileWrite, true);
+}
+
+#endif
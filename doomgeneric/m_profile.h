@@ -0,0 +1,70 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Hierarchical profiler for the engine's hot paths, for -profile.
+//
+//	Only built with FEATURE_PROFILE; otherwise the PROFILE_* macros
+//	compile to nothing.
+//
+
+#ifndef __M_PROFILE__
+#define __M_PROFILE__
+
+#include "doomtype.h"
+
+typedef enum
+{
+    PROF_DISPLAY,
+    PROF_RENDERBSPNODE,
+    PROF_DRAWPLANES,
+    PROF_DRAWMASKED,
+    PROF_FINISHUPDATE,
+    PROF_DRAWFRAME,
+    PROF_TICKER,
+    PROF_RUNTHINKERS,
+    PROF_CHECKSIGHT,
+    PROF_UPDATESOUNDS,
+
+    NUMPROFZONES
+} profzone_t;
+
+#ifdef FEATURE_PROFILE
+
+// True when -profile was given.
+extern boolean profiling;
+
+void M_ProfileInit(void);
+void M_ProfileFrame(void);
+void M_ProfileBegin(profzone_t zone);
+void M_ProfileEnd(profzone_t zone);
+
+// Zones must be strictly nested, and every PROFILE_BEGIN must be matched
+// by a PROFILE_END of the same zone on every path out of the code between.
+
+#define PROFILE_BEGIN(zone) do { if (profiling) M_ProfileBegin(zone); } while (0)
+#define PROFILE_END(zone)   do { if (profiling) M_ProfileEnd(zone); } while (0)
+
+// Marks the start of a new frame.
+#define PROFILE_FRAME()     do { if (profiling) M_ProfileFrame(); } while (0)
+
+#else
+
+#define M_ProfileInit()
+#define PROFILE_BEGIN(zone)
+#define PROFILE_END(zone)
+#define PROFILE_FRAME()
+
+#endif
+
+#endif
@@ -89,58 +89,178 @@ void A_Fall (mobj_t *actor);
 
 //
 // Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
+// Floods out through adjacent sectors,
 // sound blocking lines cut off traversal.
 //
+// Each sector reached ends up with the same soundtarget,
+// soundtraversed and validcount as the original recursive
+// flood left it with: soundtraversed is 1 where the sound got
+// without crossing a sound blocking line, and 2 where it had
+// to cross one.
+//
+// The flood from a sector is the same every time until a line
+// between two sectors opens or closes, so the sectors reached
+// from the last few sectors a sound was made in are kept, and
+// only flooded again once something has changed.
+//
+
+#define SOUNDCACHESIZE	8
+
+typedef struct
+{
+    sector_t*	start;
+    int		generation;
+    int		count;
+    int		numopen;	// reached without crossing a sound block
+    sector_t**	sectors;	// PU_LEVEL, so cleared with the level
+
+} soundcache_t;
+
+static soundcache_t	soundcache[SOUNDCACHESIZE];
+static int		soundcacherover;
+
+// Whether each line let sound through when last checked, and a count
+// of the times one has changed, which the cached floods must match.
+static byte*		soundlines;
+static int		soundgeneration;
+
+// Room for every sector, and for every sound blocking line crossed.
+static sector_t**	soundqueue;
+static sector_t**	soundblocked;
 
 mobj_t*		soundtarget;
 
-void
-P_RecursiveSound
-( sector_t*	sec,
-  int		soundblocks )
+
+//
+// SoundPassesLine
+// Same as openrange > 0 after P_LineOpening.
+//
+static boolean SoundPassesLine (line_t* line)
 {
+    fixed_t	opentop;
+    fixed_t	openbottom;
+
+    if (!(line->flags & ML_TWOSIDED) || line->backsector == NULL)
+	return false;
+
+    if (line->frontsector->ceilingheight < line->backsector->ceilingheight)
+	opentop = line->frontsector->ceilingheight;
+    else
+	opentop = line->backsector->ceilingheight;
+
+    if (line->frontsector->floorheight > line->backsector->floorheight)
+	openbottom = line->frontsector->floorheight;
+    else
+	openbottom = line->backsector->floorheight;
+
+    return opentop - openbottom > 0;
+}
+
+
+//
+// P_SoundLinesChanged
+// Called by P_ChangeSector, to note any of the sector's lines that
+// have opened or closed since sounds last went through them.
+//
+void P_SoundLinesChanged (sector_t* sec)
+{
+    boolean	open;
     int		i;
-    line_t*	check;
-    sector_t*	other;
-	
-    // wake up all monsters in this sector
-    if (sec->validcount == validcount
-	&& sec->soundtraversed <= soundblocks+1)
+    int		n;
+
+    if (soundlines == NULL)
+	return;
+
+    for (i = 0; i < sec->linecount; i++)
     {
-	return;		// already flooded
+	n = sec->lines[i] - lines;
+	open = SoundPassesLine (sec->lines[i]);
+
+	if (open != soundlines[n])
+	{
+	    soundlines[n] = open;
+	    soundgeneration++;
+	}
     }
-    
+}
+
+
+//
+// P_FloodSound
+// Puts every sector the sound reaches from sec in soundqueue, first
+// those it gets to without crossing a sound blocking line, and
+// returns how many.  Sectors are marked with validcount as they go in.
+//
+static int P_FloodSound (sector_t* sec, int* numopen)
+{
+    int		head;
+    int		tail;
+    int		numblocked;
+    int		i;
+    line_t*	check;
+    sector_t*	other;
+
+    head = tail = 0;
+    numblocked = 0;
+
     sec->validcount = validcount;
-    sec->soundtraversed = soundblocks+1;
-    sec->soundtarget = soundtarget;
-	
-    for (i=0 ;i<sec->linecount ; i++)
+    soundqueue[tail++] = sec;
+
+    while (1)
     {
-	check = sec->lines[i];
-	if (! (check->flags & ML_TWOSIDED) )
-	    continue;
-	
-	P_LineOpening (check);
+	while (head < tail)
+	{
+	    sec = soundqueue[head++];
 
-	if (openrange <= 0)
-	    continue;	// closed door
-	
-	if ( sides[ check->sidenum[0] ].sector == sec)
-	    other = sides[ check->sidenum[1] ] .sector;
-	else
-	    other = sides[ check->sidenum[0] ].sector;
-	
-	if (check->flags & ML_SOUNDBLOCK)
+	    for (i=0 ;i<sec->linecount ; i++)
+	    {
+		check = sec->lines[i];
+
+		if (!soundlines[check - lines])
+		    continue;	// closed door
+
+		if (check->frontsector == sec)
+		    other = check->backsector;
+		else
+		    other = check->frontsector;
+
+		if (check->flags & ML_SOUNDBLOCK)
+		{
+		    // Only the first sound blocking line is crossed.
+		    if (numopen != NULL)
+			soundblocked[numblocked++] = other;
+		    continue;
+		}
+
+		if (other->validcount != validcount)
+		{
+		    other->validcount = validcount;
+		    soundqueue[tail++] = other;
+		}
+	    }
+	}
+
+	if (numopen == NULL)
+	    break;
+
+	// Carry on from the far side of the sound blocking lines.
+	*numopen = tail;
+	numopen = NULL;
+
+	for (i = 0; i < numblocked; i++)
 	{
-	    if (!soundblocks)
-		P_RecursiveSound (other, 1);
+	    other = soundblocked[i];
+
+	    if (other->validcount != validcount)
+	    {
+		other->validcount = validcount;
+		soundqueue[tail++] = other;
+	    }
 	}
-	else
-	    P_RecursiveSound (other, soundblocks);
     }
-}
 
+    return tail;
+}
 
 
 //
@@ -153,9 +273,69 @@ P_NoiseAlert
 ( mobj_t*	target,
   mobj_t*	emmiter )
 {
+    soundcache_t*	cache;
+    sector_t*		sec;
+    int			numopen;
+    int			count;
+    int			i;
+
     soundtarget = target;
     validcount++;
-    P_RecursiveSound (emmiter->subsector->sector, 0);
+
+    sec = emmiter->subsector->sector;
+
+    if (soundlines == NULL)
+    {
+	// First sound of the level.
+	soundlines = Z_Malloc (numlines, PU_LEVEL, &soundlines);
+	for (i = 0; i < numlines; i++)
+	    soundlines[i] = SoundPassesLine (&lines[i]);
+
+	soundqueue = Z_Malloc (numsectors * sizeof(*soundqueue),
+	                       PU_LEVEL, &soundqueue);
+	soundblocked = Z_Malloc (numlines * 2 * sizeof(*soundblocked),
+	                         PU_LEVEL, &soundblocked);
+	soundgeneration++;
+    }
+
+    for (i = 0; i < SOUNDCACHESIZE; i++)
+    {
+	cache = &soundcache[i];
+
+	if (cache->start == sec
+	    && cache->generation == soundgeneration
+	    && cache->sectors != NULL)
+	{
+	    break;
+	}
+    }
+
+    if (i == SOUNDCACHESIZE)
+    {
+	count = P_FloodSound (sec, &numopen);
+
+	cache = &soundcache[soundcacherover];
+	soundcacherover = (soundcacherover + 1) % SOUNDCACHESIZE;
+
+	if (cache->sectors != NULL)
+	    Z_Free (cache->sectors);
+
+	cache->start = sec;
+	cache->generation = soundgeneration;
+	cache->count = count;
+	cache->numopen = numopen;
+	cache->sectors = Z_Malloc (count * sizeof(*cache->sectors),
+	                           PU_LEVEL, &cache->sectors);
+	memcpy (cache->sectors, soundqueue, count * sizeof(*cache->sectors));
+    }
+
+    for (i = 0; i < cache->count; i++)
+    {
+	sec = cache->sectors[i];
+	sec->validcount = validcount;
+	sec->soundtraversed = i < cache->numopen ? 1 : 2;
+	sec->soundtarget = soundtarget;
+    }
 }
 
 
@@ -558,7 +738,7 @@ void A_KeenDie (mobj_t* mo)
     
     // scan the remaining thinkers
     // to see if all Keens are dead
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].next ; th != &thinkerclasscap[th_mobj] ; th=th->next)
     {
 	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
 	    continue;
@@ -1460,8 +1640,8 @@ A_PainShootSkull
     // count total number of skull currently on the level
     count = 0;
 
-    currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap)
+    currentthinker = thinkerclasscap[th_mobj].next;
+    while (currentthinker != &thinkerclasscap[th_mobj])
     {
 	if (   (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    && ((mobj_t *)currentthinker)->type == MT_SKULL)
@@ -1687,7 +1867,7 @@ void A_BossDeath (mobj_t* mo)
     
     // scan the remaining thinkers to see
     // if all bosses are dead
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].next ; th != &thinkerclasscap[th_mobj] ; th=th->next)
     {
 	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
 	    continue;
@@ -1817,9 +1997,9 @@ void A_BrainAwake (mobj_t* mo)
     numbraintargets = 0;
     braintargeton = 0;
 	
-    thinker = thinkercap.next;
-    for (thinker = thinkercap.next ;
-	 thinker != &thinkercap ;
+    thinker = thinkerclasscap[th_mobj].next;
+    for (thinker = thinkerclasscap[th_mobj].next ;
+	 thinker != &thinkerclasscap[th_mobj] ;
 	 thinker = thinker->next)
     {
 	if (thinker->function.acp1 != (actionf_p1)P_MobjThinker)
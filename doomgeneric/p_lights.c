@@ -66,9 +66,9 @@ void P_SpawnFireFlicker (sector_t*	sector)
     // Nothing special about it during gameplay.
     sector->special = 0; 
 	
-    flick = Z_Malloc ( sizeof(*flick), PU_LEVSPEC, 0);
+    flick = P_AllocateThinker (th_light);
 
-    P_AddThinker (&flick->thinker);
+    P_AddThinker (&flick->thinker, th_light);
 
     flick->thinker.function.acp1 = (actionf_p1) T_FireFlicker;
     flick->sector = sector;
@@ -121,9 +121,9 @@ void P_SpawnLightFlash (sector_t*	sector)
     // nothing special about it during gameplay
     sector->special = 0;	
 	
-    flash = Z_Malloc ( sizeof(*flash), PU_LEVSPEC, 0);
+    flash = P_AllocateThinker (th_light);
 
-    P_AddThinker (&flash->thinker);
+    P_AddThinker (&flash->thinker, th_light);
 
     flash->thinker.function.acp1 = (actionf_p1) T_LightFlash;
     flash->sector = sector;
@@ -178,9 +178,9 @@ P_SpawnStrobeFlash
 {
     strobe_t*	flash;
 	
-    flash = Z_Malloc ( sizeof(*flash), PU_LEVSPEC, 0);
+    flash = P_AllocateThinker (th_light);
 
-    P_AddThinker (&flash->thinker);
+    P_AddThinker (&flash->thinker, th_light);
 
     flash->sector = sector;
     flash->darktime = fastOrSlow;
@@ -335,9 +335,9 @@ void P_SpawnGlowingLight(sector_t*	sector)
 {
     glow_t*	g;
 	
-    g = Z_Malloc( sizeof(*g), PU_LEVSPEC, 0);
+    g = P_AllocateThinker (th_light);
 
-    P_AddThinker(&g->thinker);
+    P_AddThinker(&g->thinker, th_light);
 
     g->sector = sector;
     g->minlight = P_FindMinSurroundingLight(sector,sector->lightlevel);
@@ -24,6 +24,8 @@
 #include "r_local.h"
 #endif
 
+#include "z_zone.h"
+
 #define FLOATSPEED		(FRACUNIT*4)
 
 
@@ -31,10 +33,13 @@
 #define VIEWHEIGHT		(41*FRACUNIT)
 
 // mapblocks are used to check movement
-// against lines and things
-#define MAPBLOCKUNITS	128
+// against lines and things.
+// They are 128 units unless the blockmap was
+// built with -blocksize.
+extern int		bmapshift;
+#define MAPBLOCKUNITS	(1<<bmapshift)
 #define MAPBLOCKSIZE	(MAPBLOCKUNITS*FRACUNIT)
-#define MAPBLOCKSHIFT	(FRACBITS+7)
+#define MAPBLOCKSHIFT	(FRACBITS+bmapshift)
 #define MAPBMASK		(MAPBLOCKSIZE-1)
 #define MAPBTOFRAC		(MAPBLOCKSHIFT-FRACBITS)
 
@@ -63,13 +68,42 @@
 // P_TICK
 //
 
-// both the head and tail of the thinker list
-extern	thinker_t	thinkercap;	
+// Thinkers are kept in a separate list for each class, so that each
+// list only touches one kind of structure, but are still run in the
+// order they were added in across all of them.
+typedef enum
+{
+    th_mobj,
+    th_light,
+    th_mover,
+
+    NUMTHINKERCLASSES
+} thinkerlist_t;
+
+// both the head and tail of each thinker list
+extern	thinker_t	thinkerclasscap[NUMTHINKERCLASSES];
+
+// where each list's thinkers are allocated from
+extern	zpool_t		thinkerpools[NUMTHINKERCLASSES];
+
+// For walking every thinker in the order they were added.
+typedef struct
+{
+    thinker_t*	next[NUMTHINKERCLASSES];
+} thinkeriter_t;
 
 
 void P_InitThinkers (void);
-void P_AddThinker (thinker_t* thinker);
+void P_AddThinker (thinker_t* thinker, thinkerlist_t list);
 void P_RemoveThinker (thinker_t* thinker);
+void* P_AllocateThinker2 (thinkerlist_t list, const char* file, int line);
+
+// So that -zonestats counts the pools' memory for the caller.
+#define P_AllocateThinker(l)                                   \
+    P_AllocateThinker2((l), __FILE__, __LINE__)
+void P_FreeThinker (thinker_t* thinker, thinkerlist_t list);
+void P_StartThinkers (thinkeriter_t* iter);
+thinker_t* P_NextThinker (thinkeriter_t* iter);
 
 
 //
@@ -125,6 +159,7 @@ void	P_SpawnPlayerMissile (mobj_t* source, mobjtype_t type);
 // P_ENEMY
 //
 void P_NoiseAlert (mobj_t* target, mobj_t* emmiter);
+void P_SoundLinesChanged (sector_t* sec);
 
 
 //
@@ -157,8 +192,31 @@ typedef struct
 extern intercept_t	intercepts[MAXINTERCEPTS];
 extern intercept_t*	intercept_p;
 
+// Total intercepts traversed, and the most in any one traversal, for the
+// performance overlay.
+extern int		interceptcount;
+extern int		peakintercepts;
+
 typedef boolean (*traverser_t) (intercept_t *in);
 
+// A line's geometry, copied out of the line_t and its vertexes
+// when the level is loaded, so that the side tests don't have to
+// chase pointers to find it.
+typedef struct
+{
+    fixed_t	x1;
+    fixed_t	y1;
+    fixed_t	x2;
+    fixed_t	y2;
+    fixed_t	dx;
+    fixed_t	dy;
+    fixed_t	bbox[4];
+    slopetype_t	slopetype;
+
+    // Set by P_BlockLinesIteratorBox as for the line's own.
+    int		validcount;
+} linegeom_t;
+
 fixed_t P_AproxDistance (fixed_t dx, fixed_t dy);
 int 	P_PointOnLineSide (fixed_t x, fixed_t y, line_t* line);
 int 	P_PointOnDivlineSide (fixed_t x, fixed_t y, divline_t* line);
@@ -173,8 +231,37 @@ extern fixed_t		lowfloor;
 
 void 	P_LineOpening (line_t* linedef);
 
+// A thing in a mapblock, with what is needed to pass over
+// it without looking at the mobj_t itself.
+typedef struct
+{
+    mobj_t*	thing;
+    fixed_t	x;
+    fixed_t	y;
+    fixed_t	radius;
+} blockthing_t;
+
+// The things in a mapblock, in the opposite order to its blocklinks
+// chain, so that new things go on the end.
+typedef struct
+{
+    blockthing_t*	things;
+    int			count;
+    int			size;
+    int			changes;	// counts things linked and unlinked
+
+    // Set if the chain has been broken by moving a thing without
+    // unlinking it first, so that only the chain can be followed.
+    boolean		chainonly;
+} blockcell_t;
+
 boolean P_BlockLinesIterator (int x, int y, boolean(*func)(line_t*) );
+boolean P_BlockLinesIteratorBox (int x, int y, fixed_t* box,
+                                 boolean(*func)(line_t*) );
 boolean P_BlockThingsIterator (int x, int y, boolean(*func)(mobj_t*) );
+boolean P_BlockThingsIteratorNear (int x, int y,
+                                   boolean(*near)(blockthing_t*),
+                                   boolean(*func)(mobj_t*) );
 
 #define PT_ADDLINES		1
 #define PT_ADDTHINGS	2
@@ -227,6 +314,10 @@ boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
 void	P_SlideMove (mobj_t* mo);
 boolean P_CheckSight (mobj_t* t1, mobj_t* t2);
+extern int	sightcounts[2];	// rejected by REJECT or PVS, traced through BSP
+extern int	sightcachecounts[2];	// of those traced, cache hits, misses
+void	P_InitSight (void);
+void	P_ClearSightCache (void);
 void 	P_UseLines (player_t* player);
 
 boolean P_ChangeSector (sector_t* sector, boolean crunch);
@@ -259,13 +350,15 @@ P_RadiusAttack
 // P_SETUP
 //
 extern byte*		rejectmatrix;	// for fast sight rejection
-extern short*		blockmaplump;	// offsets in blockmap are from here
-extern short*		blockmap;
+extern int*		blockmaplump;	// offsets in blockmap are from here
+extern int*		blockmap;
 extern int		bmapwidth;
 extern int		bmapheight;	// in mapblocks
 extern fixed_t		bmaporgx;
 extern fixed_t		bmaporgy;	// origin of block map
 extern mobj_t**		blocklinks;	// for thing chains
+extern blockcell_t*	blockcells;	// the same things, packed
+extern linegeom_t*	linegeom;	// for each of lines
 
 
 
@@ -91,6 +91,21 @@ int		numspechit;
 // TELEPORT MOVE
 // 
 
+//
+// PIT_NearTmThing
+// Whether a thing's box might overlap tmthing's at tmx,tmy.
+//
+static boolean PIT_NearTmThing (blockthing_t* bt)
+{
+    fixed_t	blockdist;
+
+    blockdist = bt->radius + tmthing->radius;
+
+    return abs(bt->x - tmx) < blockdist
+	&& abs(bt->y - tmy) < blockdist;
+}
+
+
 //
 // PIT_StompThing
 //
@@ -175,7 +190,7 @@ P_TeleportMove
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockThingsIterator(bx,by,PIT_StompThing))
+	    if (!P_BlockThingsIteratorNear(bx,by,PIT_NearTmThing,PIT_StompThing))
 		return false;
     
     // the move is ok,
@@ -451,7 +466,7 @@ P_CheckPosition
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+	    if (!P_BlockThingsIteratorNear(bx,by,PIT_NearTmThing,PIT_CheckThing))
 		return false;
     
     // check lines
@@ -462,7 +477,7 @@ P_CheckPosition
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockLinesIterator (bx,by,PIT_CheckLine))
+	    if (!P_BlockLinesIteratorBox (bx,by,tmbbox,PIT_CheckLine))
 		return false;
 
     return true;
@@ -522,6 +537,12 @@ P_TryMove
     thing->y = y;
 
     P_SetThingPosition (thing);
+
+    // floorz and ceilingz are what P_ThingHeightClip would find, as long
+    // as P_CheckPosition's results here don't depend on the thing being
+    // a missile or on the spechit overrun.
+    thing->clipvalid = numspechit <= MAXSPECIALCROSS_ORIGINAL
+                    && !(thing->flags & (MF_MISSILE|MF_NOCLIP));
     
     // if any special lines were hit, do the effect
     if (! (thing->flags&(MF_TELEPORT|MF_NOCLIP)) )
@@ -557,11 +578,33 @@ P_TryMove
 boolean P_ThingHeightClip (mobj_t* thing)
 {
     boolean		onfloor;
+    boolean		clear;
+
+    // If nothing the thing touches has moved since floorz and ceilingz
+    // were found, P_CheckPosition would find the same again: unless
+    // it is overlapping a solid thing, when it stops at the floor and
+    // ceiling of the sector it is in, so they have to be those too.
+    // Checking things that slam into or pick up others has side
+    // effects, so those are always checked.
+    if (thing->clipvalid
+	&& !(thing->flags & (MF_SKULLFLY|MF_MISSILE|MF_PICKUP))
+	&& thing->floorz == thing->subsector->sector->floorheight
+	&& thing->ceilingz == thing->subsector->sector->ceilingheight
+	&& thing->ceilingz - thing->floorz >= thing->height
+	&& (thing->z == thing->floorz
+	    || thing->z + thing->height <= thing->ceilingz))
+    {
+	return true;
+    }
 	
     onfloor = (thing->z == thing->floorz);
 	
-    P_CheckPosition (thing, thing->x, thing->y);	
+    clear = P_CheckPosition (thing, thing->x, thing->y);	
     // what about stranding a monster partially off an edge?
+
+    thing->clipvalid = clear
+                    && numspechit <= MAXSPECIALCROSS_ORIGINAL
+                    && !(thing->flags & (MF_MISSILE|MF_NOCLIP));
 	
     thing->floorz = tmfloorz;
     thing->ceilingz = tmceilingz;
@@ -1203,6 +1246,25 @@ mobj_t*		bombspot;
 int		bombdamage;
 
 
+//
+// PIT_NearBombSpot
+// Whether a thing might be in range of the explosion at "bombspot".
+//
+static boolean PIT_NearBombSpot (blockthing_t* bt)
+{
+    fixed_t	dx;
+    fixed_t	dy;
+    fixed_t	dist;
+
+    dx = abs(bt->x - bombspot->x);
+    dy = abs(bt->y - bombspot->y);
+
+    dist = dx>dy ? dx : dy;
+
+    return (dist - bt->radius) >> FRACBITS < bombdamage;
+}
+
+
 //
 // PIT_RadiusAttack
 // "bombsource" is the creature
@@ -1276,7 +1338,7 @@ P_RadiusAttack
 	
     for (y=yl ; y<=yh ; y++)
 	for (x=xl ; x<=xh ; x++)
-	    P_BlockThingsIterator (x, y, PIT_RadiusAttack );
+	    P_BlockThingsIteratorNear (x, y, PIT_NearBombSpot, PIT_RadiusAttack);
 }
 
 
@@ -1320,6 +1382,7 @@ boolean PIT_ChangeSector (mobj_t*	thing)
 	thing->flags &= ~MF_SOLID;
 	thing->height = 0;
 	thing->radius = 0;
+	thing->clipvalid = false;
 
 	// keep checking
 	return true;		
@@ -1369,13 +1432,25 @@ P_ChangeSector
 ( sector_t*	sector,
   boolean	crunch )
 {
+    msecnode_t*	node;
     int		x;
     int		y;
 	
+    // The sector has moved, which can change what can be seen
+    // and where sounds can get to.
+    P_ClearSightCache ();
+    P_SoundLinesChanged (sector);
+
     nofit = false;
     crushchange = crunch;
+
+    // Anything touching the sector has to be clipped again, including
+    // things outside the blocks below that won't be clipped now.
+    for (node = sector->touching_thinglist; node; node = node->m_tnext)
+	node->m_thing->clipvalid = false;
 	
-    // re-check heights for all things near the moving sector
+    // re-check heights for all things near the moving sector,
+    // which P_ThingHeightClip passes over quickly if it can
     for (x=sector->blockbox[BOXLEFT] ; x<= sector->blockbox[BOXRIGHT] ; x++)
 	for (y=sector->blockbox[BOXBOTTOM];y<= sector->blockbox[BOXTOP] ; y++)
 	    P_BlockThingsIterator (x, y, PIT_ChangeSector);
@@ -54,40 +54,40 @@ P_AproxDistance
 
 
 //
-// P_PointOnLineSide
+// PointOnLineGeomSide
 // Returns 0 or 1
 //
-int
-P_PointOnLineSide
+static inline int
+PointOnLineGeomSide
 ( fixed_t	x,
   fixed_t	y,
-  line_t*	line )
+  linegeom_t*	lg )
 {
     fixed_t	dx;
     fixed_t	dy;
     fixed_t	left;
     fixed_t	right;
 	
-    if (!line->dx)
+    if (!lg->dx)
     {
-	if (x <= line->v1->x)
-	    return line->dy > 0;
+	if (x <= lg->x1)
+	    return lg->dy > 0;
 	
-	return line->dy < 0;
+	return lg->dy < 0;
     }
-    if (!line->dy)
+    if (!lg->dy)
     {
-	if (y <= line->v1->y)
-	    return line->dx < 0;
+	if (y <= lg->y1)
+	    return lg->dx < 0;
 	
-	return line->dx > 0;
+	return lg->dx > 0;
     }
 	
-    dx = (x - line->v1->x);
-    dy = (y - line->v1->y);
+    dx = (x - lg->x1);
+    dy = (y - lg->y1);
 	
-    left = FixedMul ( line->dy>>FRACBITS , dx );
-    right = FixedMul ( dy , line->dx>>FRACBITS );
+    left = FixedMul ( lg->dy>>FRACBITS , dx );
+    right = FixedMul ( dy , lg->dx>>FRACBITS );
 	
     if (right < left)
 	return 0;		// front side
@@ -95,26 +95,25 @@ P_PointOnLineSide
 }
 
 
-
 //
-// P_BoxOnLineSide
+// BoxOnLineGeomSide
 // Considers the line to be infinite
 // Returns side 0 or 1, -1 if box crosses the line.
 //
-int
-P_BoxOnLineSide
+static inline int
+BoxOnLineGeomSide
 ( fixed_t*	tmbox,
-  line_t*	ld )
+  linegeom_t*	lg )
 {
     int		p1 = 0;
     int		p2 = 0;
 	
-    switch (ld->slopetype)
+    switch (lg->slopetype)
     {
       case ST_HORIZONTAL:
-	p1 = tmbox[BOXTOP] > ld->v1->y;
-	p2 = tmbox[BOXBOTTOM] > ld->v1->y;
-	if (ld->dx < 0)
+	p1 = tmbox[BOXTOP] > lg->y1;
+	p2 = tmbox[BOXBOTTOM] > lg->y1;
+	if (lg->dx < 0)
 	{
 	    p1 ^= 1;
 	    p2 ^= 1;
@@ -122,9 +121,9 @@ P_BoxOnLineSide
 	break;
 	
       case ST_VERTICAL:
-	p1 = tmbox[BOXRIGHT] < ld->v1->x;
-	p2 = tmbox[BOXLEFT] < ld->v1->x;
-	if (ld->dy < 0)
+	p1 = tmbox[BOXRIGHT] < lg->x1;
+	p2 = tmbox[BOXLEFT] < lg->x1;
+	if (lg->dy < 0)
 	{
 	    p1 ^= 1;
 	    p2 ^= 1;
@@ -132,13 +131,13 @@ P_BoxOnLineSide
 	break;
 	
       case ST_POSITIVE:
-	p1 = P_PointOnLineSide (tmbox[BOXLEFT], tmbox[BOXTOP], ld);
-	p2 = P_PointOnLineSide (tmbox[BOXRIGHT], tmbox[BOXBOTTOM], ld);
+	p1 = PointOnLineGeomSide (tmbox[BOXLEFT], tmbox[BOXTOP], lg);
+	p2 = PointOnLineGeomSide (tmbox[BOXRIGHT], tmbox[BOXBOTTOM], lg);
 	break;
 	
       case ST_NEGATIVE:
-	p1 = P_PointOnLineSide (tmbox[BOXRIGHT], tmbox[BOXTOP], ld);
-	p2 = P_PointOnLineSide (tmbox[BOXLEFT], tmbox[BOXBOTTOM], ld);
+	p1 = PointOnLineGeomSide (tmbox[BOXRIGHT], tmbox[BOXTOP], lg);
+	p2 = PointOnLineGeomSide (tmbox[BOXLEFT], tmbox[BOXBOTTOM], lg);
 	break;
     }
 
@@ -148,6 +147,55 @@ P_BoxOnLineSide
 }
 
 
+//
+// BoxCrossesLineGeom
+// True if the box overlaps the line's bounding box and isn't
+// wholly on one side of it, as tested by PIT_CheckLine.
+//
+static inline boolean
+BoxCrossesLineGeom
+( fixed_t*	box,
+  linegeom_t*	lg )
+{
+    if (box[BOXRIGHT] <= lg->bbox[BOXLEFT]
+	|| box[BOXLEFT] >= lg->bbox[BOXRIGHT]
+	|| box[BOXTOP] <= lg->bbox[BOXBOTTOM]
+	|| box[BOXBOTTOM] >= lg->bbox[BOXTOP])
+	return false;
+
+    return BoxOnLineGeomSide (box, lg) == -1;
+}
+
+
+//
+// P_PointOnLineSide
+// Returns 0 or 1
+//
+int
+P_PointOnLineSide
+( fixed_t	x,
+  fixed_t	y,
+  line_t*	line )
+{
+    return PointOnLineGeomSide (x, y, &linegeom[line - lines]);
+}
+
+
+
+//
+// P_BoxOnLineSide
+// Considers the line to be infinite
+// Returns side 0 or 1, -1 if box crosses the line.
+//
+int
+P_BoxOnLineSide
+( fixed_t*	tmbox,
+  line_t*	ld )
+{
+    return BoxOnLineGeomSide (tmbox, &linegeom[ld - lines]);
+}
+
+
 //
 // P_PointOnDivlineSide
 // Returns 0 or 1.
@@ -331,6 +379,195 @@ void P_LineOpening (line_t* linedef)
 // THING POSITION SETTING
 //
 
+// Links between things and the sectors they touch.
+static zpool_t	secnodepool;
+
+
+//
+// AddThingSector
+// Links a thing to a sector, unless it is already.
+//
+static void AddThingSector (mobj_t* thing, sector_t* sec)
+{
+    msecnode_t*	node;
+
+    for (node = thing->touching_sectorlist; node; node = node->m_snext)
+    {
+	if (node->m_sector == sec)
+	    return;
+    }
+
+    node = Z_PoolMalloc (&secnodepool);
+    node->m_sector = sec;
+    node->m_thing = thing;
+
+    node->m_snext = thing->touching_sectorlist;
+    thing->touching_sectorlist = node;
+
+    node->m_tprev = NULL;
+    node->m_tnext = sec->touching_thinglist;
+    if (sec->touching_thinglist)
+	sec->touching_thinglist->m_tprev = node;
+    sec->touching_thinglist = node;
+}
+
+
+//
+// P_SetThingSectors
+// Links a thing to every sector that P_CheckPosition would take its
+// floor and ceiling from: the one it is in, and both sides of every
+// line crossing its bounding box.  The lines are found without using
+// validcount, as this can be called in the middle of P_CheckPosition.
+//
+static void P_SetThingSectors (mobj_t* thing)
+{
+    fixed_t	bbox[4];
+    int		xl;
+    int		xh;
+    int		yl;
+    int		yh;
+    int		bx;
+    int		by;
+    int*	list;
+    line_t*	ld;
+
+    if (secnodepool.size == 0)
+	Z_PoolInit (&secnodepool, sizeof(msecnode_t), 256);
+
+    thing->touching_sectorlist = NULL;
+    AddThingSector (thing, thing->subsector->sector);
+
+    bbox[BOXTOP] = thing->y + thing->radius;
+    bbox[BOXBOTTOM] = thing->y - thing->radius;
+    bbox[BOXRIGHT] = thing->x + thing->radius;
+    bbox[BOXLEFT] = thing->x - thing->radius;
+
+    xl = (bbox[BOXLEFT] - bmaporgx)>>MAPBLOCKSHIFT;
+    xh = (bbox[BOXRIGHT] - bmaporgx)>>MAPBLOCKSHIFT;
+    yl = (bbox[BOXBOTTOM] - bmaporgy)>>MAPBLOCKSHIFT;
+    yh = (bbox[BOXTOP] - bmaporgy)>>MAPBLOCKSHIFT;
+
+    if (xl < 0)
+	xl = 0;
+    if (yl < 0)
+	yl = 0;
+    if (xh >= bmapwidth)
+	xh = bmapwidth - 1;
+    if (yh >= bmapheight)
+	yh = bmapheight - 1;
+
+    for (bx=xl ; bx<=xh ; bx++)
+    {
+	for (by=yl ; by<=yh ; by++)
+	{
+	    for (list = blockmaplump + blockmap[by*bmapwidth+bx] ;
+		 *list != -1 ;
+		 list++)
+	    {
+		if (!BoxCrossesLineGeom (bbox, &linegeom[*list]))
+		    continue;
+
+		ld = &lines[*list];
+		AddThingSector (thing, ld->frontsector);
+		if (ld->backsector)
+		    AddThingSector (thing, ld->backsector);
+	    }
+	}
+    }
+}
+
+
+//
+// P_UnsetThingSectors
+//
+static void P_UnsetThingSectors (mobj_t* thing)
+{
+    msecnode_t*	node;
+    msecnode_t*	next;
+
+    for (node = thing->touching_sectorlist; node; node = next)
+    {
+	next = node->m_snext;
+
+	if (node->m_tnext)
+	    node->m_tnext->m_tprev = node->m_tprev;
+
+	if (node->m_tprev)
+	    node->m_tprev->m_tnext = node->m_tnext;
+	else
+	    node->m_sector->touching_thinglist = node->m_tnext;
+
+	Z_PoolFree (&secnodepool, node);
+    }
+
+    thing->touching_sectorlist = NULL;
+}
+
+
+
+//
+// LinkBlockThing
+// Adds a thing to the end of a mapblock's things.
+//
+static void LinkBlockThing (mobj_t* thing, int block)
+{
+    blockcell_t*	cell = &blockcells[block];
+    blockthing_t*	things;
+    blockthing_t*	bt;
+
+    if (cell->count == cell->size)
+    {
+	cell->size = cell->size ? cell->size * 2 : 8;
+	things = Z_Malloc (cell->size * sizeof(*things), PU_LEVEL, NULL);
+	if (cell->count)
+	{
+	    memcpy (things, cell->things, cell->count * sizeof(*things));
+	    Z_Free (cell->things);
+	}
+	cell->things = things;
+    }
+
+    bt = &cell->things[cell->count++];
+    bt->thing = thing;
+    bt->x = thing->x;
+    bt->y = thing->y;
+    bt->radius = thing->radius;
+
+    cell->changes++;
+    thing->blockcell = block;
+}
+
+
+//
+// UnlinkBlockThing
+// Takes a thing out of the mapblock it was linked into, keeping the
+// others in order.
+//
+static void UnlinkBlockThing (mobj_t* thing)
+{
+    blockcell_t*	cell;
+    int			i;
+
+    if (thing->blockcell < 0)
+	return;
+
+    cell = &blockcells[thing->blockcell];
+
+    for (i = cell->count - 1; i >= 0; i--)
+    {
+	if (cell->things[i].thing == thing)
+	{
+	    memmove (&cell->things[i], &cell->things[i + 1],
+	             (cell->count - i - 1) * sizeof(*cell->things));
+	    cell->count--;
+	    break;
+	}
+    }
+
+    cell->changes++;
+    thing->blockcell = -1;
+}
+
 
 //
 // P_UnsetThingPosition
@@ -375,9 +612,26 @@ void P_UnsetThingPosition (mobj_t* thing)
 		&& blocky>=0 && blocky <bmapheight)
 	    {
 		blocklinks[blocky*bmapwidth+blockx] = thing->bnext;
+
+		// If the thing has moved since it was linked, this has
+		// broken the chain for both mapblocks.
+		if (blocky*bmapwidth+blockx != thing->blockcell)
+		{
+		    blockcells[blocky*bmapwidth+blockx].chainonly = true;
+		    if (thing->blockcell >= 0)
+			blockcells[thing->blockcell].chainonly = true;
+		}
+	    }
+	    else if (thing->blockcell >= 0)
+	    {
+		blockcells[thing->blockcell].chainonly = true;
 	    }
 	}
+
+	UnlinkBlockThing (thing);
     }
+
+    P_UnsetThingSectors (thing);
 }
 
 
@@ -435,13 +689,27 @@ P_SetThingPosition (mobj_t* thing)
 		(*link)->bprev = thing;
 
 	    *link = thing;
+
+	    LinkBlockThing (thing, blocky*bmapwidth+blockx);
 	}
 	else
 	{
 	    // thing is off the map
 	    thing->bnext = thing->bprev = NULL;
+	    thing->blockcell = -1;
 	}
+
+	// only things in the blockmap are found by P_ChangeSector
+	P_SetThingSectors (thing);
     }
+    else
+    {
+	thing->blockcell = -1;
+	thing->touching_sectorlist = NULL;
+    }
+
+    // floorz and ceilingz are up to whoever moved it
+    thing->clipvalid = false;
 }
 
 
@@ -470,7 +738,7 @@ P_BlockLinesIterator
   boolean(*func)(line_t*) )
 {
     int			offset;
-    short*		list;
+    int*		list;
     line_t*		ld;
 	
     if (x<0
@@ -501,6 +769,65 @@ P_BlockLinesIterator
 }
 
 
+//
+// P_BlockLinesIteratorBox
+// As P_BlockLinesIterator, but only passes func the lines that
+// cross the box, so func must do nothing with the others.
+// The rest are rejected from linegeom, without looking at
+// their line_t.
+//
+boolean
+P_BlockLinesIteratorBox
+( int			x,
+  int			y,
+  fixed_t*		box,
+  boolean(*func)(line_t*) )
+{
+    int			offset;
+    int*		list;
+    line_t*		ld;
+    linegeom_t*		lg;
+	
+    if (x<0
+	|| y<0
+	|| x>=bmapwidth
+	|| y>=bmapheight)
+    {
+	return true;
+    }
+    
+    offset = y*bmapwidth+x;
+	
+    offset = *(blockmap+offset);
+
+    for ( list = blockmaplump+offset ; *list != -1 ; list++)
+    {
+	lg = &linegeom[*list];
+
+	// The box can change between calls (see SpechitOverrun), so
+	// rejected lines must be passed over later too.
+	if (lg->validcount == validcount)
+	    continue;
+
+	lg->validcount = validcount;
+
+	if (!BoxCrossesLineGeom (box, lg))
+	    continue;
+
+	ld = &lines[*list];
+
+	if (ld->validcount == validcount)
+	    continue; 	// line has already been checked
+
+	ld->validcount = validcount;
+		
+	if ( !func(ld) )
+	    return false;
+    }
+    return true;	// everything was checked
+}
+
+
 //
 // P_BlockThingsIterator
 //
@@ -510,7 +837,28 @@ P_BlockThingsIterator
   int			y,
   boolean(*func)(mobj_t*) )
 {
+    return P_BlockThingsIteratorNear (x, y, NULL, func);
+}
+
+
+//
+// P_BlockThingsIteratorNear
+// As P_BlockThingsIterator, but things are only passed to func if
+// near returns true for them, which it works out from the packed
+// copy of their position and radius.  It must only return false for
+// things that func would do nothing with and return true for.
+//
+boolean
+P_BlockThingsIteratorNear
+( int			x,
+  int			y,
+  boolean(*near)(blockthing_t*),
+  boolean(*func)(mobj_t*) )
+{
+    blockcell_t*	cell;
     mobj_t*		mobj;
+    int			changes;
+    int			i;
 	
     if ( x<0
 	 || y<0
@@ -519,11 +867,42 @@ P_BlockThingsIterator
     {
 	return true;
     }
-    
 
-    for (mobj = blocklinks[y*bmapwidth+x] ;
-	 mobj ;
-	 mobj = mobj->bnext)
+    cell = &blockcells[y*bmapwidth+x];
+
+    if (cell->chainonly)
+    {
+	mobj = blocklinks[y*bmapwidth+x];
+    }
+    else
+    {
+	changes = cell->changes;
+	mobj = NULL;
+
+	for (i = cell->count - 1 ; i >= 0 ; i--)
+	{
+	    if (near != NULL && !near (&cell->things[i]))
+		continue;
+
+	    mobj = cell->things[i].thing;
+
+	    if (!func( mobj ) )
+		return false;
+
+	    // If func linked or unlinked any things here, follow the
+	    // chain from this thing instead, as that is what decides
+	    // which of them are reached.
+	    if (cell->changes != changes)
+		break;
+	}
+
+	if (i < 0)
+	    return true;
+
+	mobj = mobj->bnext;
+    }
+
+    for ( ; mobj ; mobj = mobj->bnext)
     {
 	if (!func( mobj ) )
 	    return false;
@@ -538,6 +917,8 @@ P_BlockThingsIterator
 //
 intercept_t	intercepts[MAXINTERCEPTS];
 intercept_t*	intercept_p;
+int		interceptcount;
+int		peakintercepts;
 
 divline_t 	trace;
 boolean 	earlyout;
@@ -562,6 +943,9 @@ PIT_AddLineIntercepts (line_t* ld)
     int			s2;
     fixed_t		frac;
     divline_t		dl;
+    linegeom_t*		lg;
+
+    lg = &linegeom[ld - lines];
 	
     // avoid precision problems with two routines
     if ( trace.dx > FRACUNIT*16
@@ -569,20 +953,23 @@ PIT_AddLineIntercepts (line_t* ld)
 	 || trace.dx < -FRACUNIT*16
 	 || trace.dy < -FRACUNIT*16)
     {
-	s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &trace);
-	s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &trace);
+	s1 = P_PointOnDivlineSide (lg->x1, lg->y1, &trace);
+	s2 = P_PointOnDivlineSide (lg->x2, lg->y2, &trace);
     }
     else
     {
-	s1 = P_PointOnLineSide (trace.x, trace.y, ld);
-	s2 = P_PointOnLineSide (trace.x+trace.dx, trace.y+trace.dy, ld);
+	s1 = PointOnLineGeomSide (trace.x, trace.y, lg);
+	s2 = PointOnLineGeomSide (trace.x+trace.dx, trace.y+trace.dy, lg);
     }
     
     if (s1 == s2)
 	return true;	// line isn't crossed
     
     // hit the line
-    P_MakeDivline (ld, &dl);
+    dl.x = lg->x1;
+    dl.y = lg->y1;
+    dl.dx = lg->dx;
+    dl.dy = lg->dy;
     frac = P_InterceptVector (&trace, &dl);
 
     if (frac < 0)
@@ -677,6 +1064,13 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
 // P_TraverseIntercepts
 // Returns true if the traverser function returns true
 // for all lines.
+//
+// The intercepts are visited nearest first. Vanilla looked for the
+// nearest one left on each step; sorting them first, keeping the
+// ones at the same distance in the order they were added, visits them
+// in the same order without rescanning the list every time. They are
+// sorted where they are, after InterceptsOverrun has seen them in the
+// order they were added.
 // 
 boolean
 P_TraverseIntercepts
@@ -684,45 +1078,35 @@ P_TraverseIntercepts
   fixed_t	maxfrac )
 {
     int			count;
-    fixed_t		dist;
     intercept_t*	scan;
     intercept_t*	in;
+    intercept_t		next;
 	
     count = intercept_p - intercepts;
-    
-    in = 0;			// shut up compiler warning
-	
-    while (count--)
-    {
-	dist = INT_MAX;
-	for (scan = intercepts ; scan<intercept_p ; scan++)
-	{
-	    if (scan->frac < dist)
-	    {
-		dist = scan->frac;
-		in = scan;
-	    }
-	}
-	
-	if (dist > maxfrac)
-	    return true;	// checked everything in range		
 
-#if 0  // UNUSED
+    interceptcount += count;
+    if (count > peakintercepts)
+	peakintercepts = count;
+
+    // Insertion sort, since there are usually only a few, and they
+    // are mostly added in order along the trace already.
+    for (scan = intercepts + 1 ; scan<intercept_p ; scan++)
     {
-	// don't check these yet, there may be others inserted
-	in = scan = intercepts;
-	for ( scan = intercepts ; scan<intercept_p ; scan++)
-	    if (scan->frac > maxfrac)
-		*in++ = *scan;
-	intercept_p = in;
-	return false;
+	next = *scan;
+
+	for (in = scan ; in > intercepts && in[-1].frac > next.frac ; in--)
+	    in[0] = in[-1];
+
+	*in = next;
     }
-#endif
+	
+    for (in = intercepts ; in<intercept_p ; in++)
+    {
+	if (in->frac > maxfrac)
+	    return true;	// checked everything in range		
 
         if ( !func (in) )
 	    return false;	// don't bother going farther
-
-	in->frac = INT_MAX;
     }
 	
     return true;		// everything was traversed
@@ -886,6 +1270,7 @@ P_PathTraverse
     int		mapystep;
 
     int		count;
+    int		maxcount;
 		
     earlyout = flags & PT_EARLYOUT;
 		
@@ -958,10 +1343,12 @@ P_PathTraverse
     // Step through map blocks.
     // Count is present to prevent a round off error
     // from skipping the break.
+    // Smaller mapblocks need more steps to go as far.
     mapx = xt1;
     mapy = yt1;
+    maxcount = bmapshift < 7 ? 64 << (7 - bmapshift) : 64;
 	
-    for (count = 0 ; count < 64 ; count++)
+    for (count = 0 ; count < maxcount ; count++)
     {
 	if (flags & PT_ADDLINES)
 	{
@@ -276,6 +276,16 @@ typedef struct mobj_s
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
+
+    // Sectors the bounding box touches, linked in P_SetThingPosition.
+    struct msecnode_s*	touching_sectorlist;
+
+    // Mapblock it was linked into, or -1 if off the map.
+    int			blockcell;
+
+    // True while floorz and ceilingz are what P_CheckPosition
+    // would find here, so that P_ChangeSector can pass it over.
+    boolean		clipvalid;
     
 } mobj_t;
 
@@ -160,8 +160,8 @@ EV_DoPlat
 	
 	// Find lowest & highest floors around sector
 	rtn = 1;
-	plat = Z_Malloc( sizeof(*plat), PU_LEVSPEC, 0);
-	P_AddThinker(&plat->thinker);
+	plat = P_AllocateThinker (th_mover);
+	P_AddThinker(&plat->thinker, th_mover);
 		
 	plat->type = type;
 	plat->sector = sec;
@@ -0,0 +1,338 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Prefetching of the next level's lumps during the intermission.
+//
+//	The intermission spends most of its time waiting for the player,
+//	so the next map, and the flats, textures and sprites it looks like
+//	it will need, are read into the WAD cache a little at a time from
+//	its ticker. P_SetupLevel then finds most of what it needs already
+//	there. Everything is loaded PU_CACHE, so it can be purged again if
+//	the memory is needed before then.
+//
+//	This all runs on the game loop between frames, rather than on a
+//	thread of its own, since neither the zone allocator nor the WAD
+//	code can be used from more than one thread.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deh_main.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "i_swap.h"
+#include "i_timer.h"
+#include "info.h"
+#include "m_argv.h"
+#include "p_local.h"
+#include "p_prefetch.h"
+#include "p_setup.h"
+#include "r_data.h"
+#include "r_sky.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Amount of lump data to load in each intermission tic. This needs to
+// stay well under a tic's worth of reading on slow storage, so that
+// the intermission animations keep running smoothly.
+#define PREFETCH_BYTES_PER_TIC (64 * 1024)
+
+typedef enum
+{
+    PREFETCH_IDLE,
+    PREFETCH_MAP,       // load the map's own lumps
+    PREFETCH_PREDICT,   // work out what else the map will need
+    PREFETCH_LOAD,      // load that, a slice at a time
+} prefetchstate_t;
+
+static prefetchstate_t state = PREFETCH_IDLE;
+static boolean noprefetch;
+
+static char maplumpname[9];
+static int maplump;
+static int mapnum;
+
+static int *lumps;
+static int numlumps_fetch;
+static int nextlump;
+
+// Totals for the current prefetch, reported by P_StopPrefetch.
+static int prefetched_lumps;
+static int prefetched_bytes;
+static uint64_t prefetch_ns;
+
+void P_StartPrefetch (int episode, int map)
+{
+    static boolean checked = false;
+
+    if (!checked)
+    {
+        //!
+        // @category obscure
+        //
+        // Don't read the next level into the cache during the
+        // intermission.
+        //
+
+        noprefetch = M_CheckParm("-noprefetch") > 0;
+        checked = true;
+    }
+
+    P_StopPrefetch();
+
+    if (noprefetch)
+    {
+        return;
+    }
+
+    P_MapLumpName(episode, map, maplumpname);
+    maplump = W_CheckNumForName(maplumpname);
+    mapnum = map;
+
+    if (maplump < 0)
+    {
+        return;
+    }
+
+    prefetched_lumps = 0;
+    prefetched_bytes = 0;
+    prefetch_ns = 0;
+    state = PREFETCH_MAP;
+}
+
+// Mark the flat with the given name, if there is one.
+
+static void MarkFlat (char *flatpresent, char *name)
+{
+    int lump;
+
+    lump = W_CheckNumForName(name);
+
+    if (lump >= firstflat && lump < firstflat + numflats)
+    {
+        flatpresent[lump - firstflat] = 1;
+    }
+}
+
+static void MarkTexture (char *texturepresent, char *name)
+{
+    int texture;
+
+    texture = R_CheckTextureNumForName(name);
+
+    if (texture > 0)
+    {
+        texturepresent[texture] = 1;
+    }
+}
+
+// The sky the next level will be drawn with. This follows G_DoLoadLevel:
+// only the Final Doom executable picks the sky by map number, and
+// otherwise the sky set by G_InitNew is kept from level to level.
+
+static int NextSkyTexture (void)
+{
+    if ((gamemode == commercial)
+     && (gameversion == exe_final2 || gameversion == exe_chex))
+    {
+        if (mapnum < 12)
+        {
+            return R_CheckTextureNumForName(DEH_String("SKY1"));
+        }
+        else if (mapnum < 21)
+        {
+            return R_CheckTextureNumForName(DEH_String("SKY2"));
+        }
+        else
+        {
+            return R_CheckTextureNumForName(DEH_String("SKY3"));
+        }
+    }
+
+    return skytexture;
+}
+
+// The same flats, textures and sprites that R_PrecacheLevel would find
+// once the level is running, read straight from the map's lumps.
+
+static void PredictLumps (void)
+{
+    char *flatpresent;
+    char *texturepresent;
+    char *spritepresent;
+    mapsector_t *ms;
+    mapsidedef_t *msd;
+    mapthing_t *mt;
+    int count;
+    int texture;
+    int type;
+    int i;
+
+    flatpresent = Z_Malloc(numflats, PU_STATIC, NULL);
+    memset(flatpresent, 0, numflats);
+
+    ms = W_CacheLumpNum(maplump + ML_SECTORS, PU_STATIC);
+    count = W_LumpLength(maplump + ML_SECTORS) / sizeof(mapsector_t);
+    for (i = 0; i < count; ++i)
+    {
+        MarkFlat(flatpresent, ms[i].floorpic);
+        MarkFlat(flatpresent, ms[i].ceilingpic);
+    }
+    W_ReleaseLumpNum(maplump + ML_SECTORS);
+
+    texturepresent = Z_Malloc(numtextures, PU_STATIC, NULL);
+    memset(texturepresent, 0, numtextures);
+
+    msd = W_CacheLumpNum(maplump + ML_SIDEDEFS, PU_STATIC);
+    count = W_LumpLength(maplump + ML_SIDEDEFS) / sizeof(mapsidedef_t);
+    for (i = 0; i < count; ++i)
+    {
+        MarkTexture(texturepresent, msd[i].toptexture);
+        MarkTexture(texturepresent, msd[i].midtexture);
+        MarkTexture(texturepresent, msd[i].bottomtexture);
+    }
+    W_ReleaseLumpNum(maplump + ML_SIDEDEFS);
+
+    // R_PrecacheLevel always marks the sky texture, but it's the one
+    // G_DoLoadLevel has set by then, not the one we have now.
+
+    texture = NextSkyTexture();
+
+    if (texture > 0)
+    {
+        texturepresent[texture] = 1;
+    }
+
+    // Things are only marked by the sprite they spawn with, which
+    // R_PrecacheLevel would see too, and all of a sprite's frames are
+    // loaded. Player starts spawn MT_PLAYER, which has no doomednum.
+
+    spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
+    memset(spritepresent, 0, numsprites);
+    spritepresent[states[mobjinfo[MT_PLAYER].spawnstate].sprite] = 1;
+
+    mt = W_CacheLumpNum(maplump + ML_THINGS, PU_STATIC);
+    count = W_LumpLength(maplump + ML_THINGS) / sizeof(mapthing_t);
+    for (i = 0; i < count; ++i)
+    {
+        for (type = 0; type < NUMMOBJTYPES; ++type)
+        {
+            if (SHORT(mt[i].type) == mobjinfo[type].doomednum)
+            {
+                spritepresent[states[mobjinfo[type].spawnstate].sprite] = 1;
+                break;
+            }
+        }
+    }
+    W_ReleaseLumpNum(maplump + ML_THINGS);
+
+    lumps = R_PrecacheLumps(flatpresent, texturepresent, spritepresent,
+                            &numlumps_fetch);
+    nextlump = 0;
+
+    Z_Free(flatpresent);
+    Z_Free(texturepresent);
+    Z_Free(spritepresent);
+}
+
+// Load the next slice of the list.
+
+static void LoadLumps (void)
+{
+    int bytes;
+    int first;
+
+    first = nextlump;
+    bytes = 0;
+
+    while (nextlump < numlumps_fetch && bytes < PREFETCH_BYTES_PER_TIC)
+    {
+        bytes += W_LumpLength(lumps[nextlump]);
+        ++nextlump;
+    }
+
+    W_CacheLumpBatch(lumps + first, nextlump - first, PU_CACHE);
+
+    prefetched_lumps += nextlump - first;
+    prefetched_bytes += bytes;
+}
+
+void P_PrefetchTicker (void)
+{
+    int maplumps[ML_BLOCKMAP + 1];
+    uint64_t start;
+    int i;
+
+    if (state == PREFETCH_IDLE)
+    {
+        return;
+    }
+
+    start = I_GetTimeNS();
+
+    switch (state)
+    {
+      case PREFETCH_MAP:
+        for (i = 0; i <= ML_BLOCKMAP && maplump + i < numlumps; ++i)
+        {
+            maplumps[i] = maplump + i;
+            prefetched_bytes += W_LumpLength(maplump + i);
+        }
+        W_CacheLumpBatch(maplumps, i, PU_CACHE);
+        prefetched_lumps += i;
+        state = PREFETCH_PREDICT;
+        break;
+
+      case PREFETCH_PREDICT:
+        PredictLumps();
+        state = PREFETCH_LOAD;
+        break;
+
+      case PREFETCH_LOAD:
+        LoadLumps();
+        if (nextlump >= numlumps_fetch)
+        {
+            Z_Free(lumps);
+            lumps = NULL;
+            state = PREFETCH_IDLE;
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    prefetch_ns += I_GetTimeNS() - start;
+}
+
+void P_StopPrefetch (void)
+{
+    if (devparm && prefetched_lumps > 0)
+    {
+        printf("P_StopPrefetch: %s: %d lumps (%d bytes) prefetched "
+               "in %.1f ms%s\n", maplumpname, prefetched_lumps,
+               prefetched_bytes, prefetch_ns / 1000000.0,
+               state == PREFETCH_IDLE ? "" : ", unfinished");
+    }
+
+    if (lumps != NULL)
+    {
+        Z_Free(lumps);
+        lumps = NULL;
+    }
+
+    prefetched_lumps = 0;
+    state = PREFETCH_IDLE;
+}
@@ -0,0 +1,30 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Prefetching of the next level's lumps during the intermission.
+//
+
+#ifndef __P_PREFETCH__
+#define __P_PREFETCH__
+
+// Called by G_DoCompleted with the level the intermission leads to.
+void P_StartPrefetch (int episode, int map);
+
+// Called every intermission tic, to load a little more.
+void P_PrefetchTicker (void);
+
+// Called by P_SetupLevel. Drops whatever hasn't been loaded yet.
+void P_StopPrefetch (void);
+
+#endif
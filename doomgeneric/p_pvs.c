@@ -0,0 +1,614 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Sector potentially visible sets, built at level load for -pvs.
+//
+//	Many PWADs have an empty REJECT lump, so every sight check that
+//	isn't between the same two sectors goes through the BSP. This
+//	works out which sectors could possibly see each other, from the
+//	two-sided lines between them, and P_CheckSight uses that as a
+//	second REJECT.
+//
+//	A line of sight leaves its sector through a two-sided line, and
+//	then has to pass through a two-sided line of each sector after
+//	that. Each one it can reach is clipped to the part that a straight
+//	line through the first and the previous one can reach, as in
+//	Quake's vis. Floor and ceiling heights are ignored, since they
+//	change, so the result is conservative. So that it is also
+//	conservative for the rounding in P_CrossSubsector, the lines are
+//	lengthened and the clipping is loosened by PVS_SLACK.
+//
+//	Even so, vanilla's sight checks can see through the ends of walls
+//	in ways that no geometric test can follow exactly, so the PVS is
+//	never used in demos or netgames, which depend on every sight
+//	check giving the same result as it did in vanilla.
+//
+//	Building it can take a while on large maps, so it is saved in the
+//	configuration directory, keyed by a hash of the map.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "p_pvs.h"
+#include "r_state.h"
+#include "sha1.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+#define PVSCACHE_MAGIC		"DGPVSCAC"
+#define PVSCACHE_VERSION	1
+
+// How far, in map units, the lines and clipping are loosened by.
+#define PVS_SLACK		4.0
+
+// Limits on the search from each sector. A sector that goes over them
+// is taken to be able to see every other sector.
+#define PVS_MAXWORK		200000
+#define PVS_MAXDEPTH		256
+
+typedef struct
+{
+    char		magic[8];
+    int			version;
+    int			size;
+    sha1_digest_t	key;
+    int			numsectors;
+} pvscache_header_t;
+
+typedef struct
+{
+    double		x1, y1;
+    double		x2, y2;
+} pvsseg_t;
+
+// A two-sided line that can be seen through.
+typedef struct
+{
+    pvsseg_t		seg;
+    int			front;
+    int			back;
+} pvsportal_t;
+
+byte*			pvsmatrix;
+
+static boolean		usepvs;
+
+static pvsportal_t*	portals;
+static int		numportals;
+
+// The portals of each sector are sectorportals[portalstart[s]] up to
+//  sectorportals[portalstart[s + 1]].
+static int*		portalstart;
+static int*		sectorportals;
+
+// The portals that the current line of sight passes through.
+static byte*		inflow;
+
+// The sectors that can be seen from the current one.
+static byte*		visible;
+
+static int		work;
+static boolean		overflow;
+
+// Sectors that went over the limits in the last BuildPVS.
+static int		numoverflows;
+
+void P_InitPVS (void)
+{
+    //!
+    // @category obscure
+    //
+    // Work out which sectors can't possibly see each other when a level
+    // is loaded, and skip the sight checks between them. Many PWADs
+    // don't have a REJECT lump that does this. Not used in demos or
+    // netgames. The result is kept in the configuration directory.
+    //
+
+    usepvs = M_CheckParm("-pvs") > 0;
+}
+
+// Which side of the line a-b the point is on: positive on the left,
+//  negative on the right, scaled so that it is at least the distance.
+
+static double Side (double ax, double ay, double bx, double by,
+                    double x, double y)
+{
+    double	dx = bx - ax;
+    double	dy = by - ay;
+    double	len;
+
+    len = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+
+    if (len == 0)
+	return 0;
+
+    return (dx * (y - ay) - dy * (x - ax)) / len;
+}
+
+// Keep the part of the segment on the given side of the line a-b, or
+//  within PVS_SLACK of it. Returns false if there is none.
+
+static boolean ClipSeg (pvsseg_t *seg, double ax, double ay,
+                        double bx, double by, int side)
+{
+    double	d1;
+    double	d2;
+    double	f;
+    double	x;
+    double	y;
+
+    d1 = side * Side(ax, ay, bx, by, seg->x1, seg->y1) + PVS_SLACK;
+    d2 = side * Side(ax, ay, bx, by, seg->x2, seg->y2) + PVS_SLACK;
+
+    if (d1 >= 0 && d2 >= 0)
+	return true;
+
+    if (d1 < 0 && d2 < 0)
+	return false;
+
+    f = d1 / (d1 - d2);
+    x = seg->x1 + f * (seg->x2 - seg->x1);
+    y = seg->y1 + f * (seg->y2 - seg->y1);
+
+    if (d1 < 0)
+    {
+	seg->x1 = x;
+	seg->y1 = y;
+    }
+    else
+    {
+	seg->x2 = x;
+	seg->y2 = y;
+    }
+
+    return true;
+}
+
+// Clip the target to what can be reached by a straight line through
+//  both the source and the pass. The lines through an end of each,
+//  that have the source and the pass on either side, bound that.
+
+static boolean ClipToSeparators (pvsseg_t *target, pvsseg_t *source,
+                                 pvsseg_t *pass)
+{
+    double	sx[2], sy[2];
+    double	px[2], py[2];
+    double	s, p;
+    int		i;
+    int		j;
+
+    sx[0] = source->x1; sy[0] = source->y1;
+    sx[1] = source->x2; sy[1] = source->y2;
+    px[0] = pass->x1; py[0] = pass->y1;
+    px[1] = pass->x2; py[1] = pass->y2;
+
+    for (i = 0; i < 2; ++i)
+    {
+	for (j = 0; j < 2; ++j)
+	{
+	    s = Side(sx[i], sy[i], px[j], py[j], sx[i ^ 1], sy[i ^ 1]);
+	    p = Side(sx[i], sy[i], px[j], py[j], px[j ^ 1], py[j ^ 1]);
+
+	    if ((s < 0 && p > 0) || (s > 0 && p < 0))
+	    {
+		if (!ClipSeg(target, sx[i], sy[i], px[j], py[j],
+		             p > 0 ? 1 : -1))
+		    return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+// The side of a portal that the given sector is on.
+
+static int PortalSide (pvsportal_t *portal, int sector)
+{
+    // The front sector is on the right.
+    return sector == portal->front ? -1 : 1;
+}
+
+//
+// Flow
+// The line of sight has come through the source and then the pass,
+//  into the given sector. Carry on through each of its portals.
+//
+static void Flow (pvsseg_t *source, pvsseg_t *pass, int passside,
+                  int sector, int depth)
+{
+    pvsportal_t*	portal;
+    pvsseg_t		target;
+    int			other;
+    int			i;
+
+    visible[sector] = 1;
+
+    if (overflow)
+	return;
+
+    if (++work > PVS_MAXWORK || depth > PVS_MAXDEPTH)
+    {
+	overflow = true;
+	return;
+    }
+
+    for (i = portalstart[sector]; i < portalstart[sector + 1]; ++i)
+    {
+	portal = &portals[sectorportals[i]];
+
+	// A straight line can only cross each line once.
+	if (inflow[sectorportals[i]])
+	    continue;
+
+	other = portal->front == sector ? portal->back : portal->front;
+	target = portal->seg;
+
+	// It must be beyond the pass, and in line with the source.
+
+	if (!ClipSeg(&target, pass->x1, pass->y1, pass->x2, pass->y2,
+	             passside))
+	    continue;
+
+	if (pass != source && !ClipToSeparators(&target, source, pass))
+	    continue;
+
+	inflow[sectorportals[i]] = 1;
+	Flow(source, &target, PortalSide(portal, other), other, depth + 1);
+	inflow[sectorportals[i]] = 0;
+    }
+}
+
+// Find the sectors that can be seen from the given one.
+
+static void SectorVisibility (int sector)
+{
+    pvsportal_t*	portal;
+    int			other;
+    int			i;
+
+    memset(visible, 0, numsectors);
+    visible[sector] = 1;
+
+    work = 0;
+    overflow = false;
+
+    for (i = portalstart[sector]; i < portalstart[sector + 1]; ++i)
+    {
+	portal = &portals[sectorportals[i]];
+	other = portal->front == sector ? portal->back : portal->front;
+
+	inflow[sectorportals[i]] = 1;
+	Flow(&portal->seg, &portal->seg, PortalSide(portal, other),
+	     other, 0);
+	inflow[sectorportals[i]] = 0;
+    }
+
+    // Give up on it, rather than leave out sectors it might see.
+
+    if (overflow)
+    {
+	memset(visible, 1, numsectors);
+	++numoverflows;
+    }
+}
+
+static void FindPortals (void)
+{
+    line_t*		line;
+    pvsportal_t*	portal;
+    double		dx, dy, len;
+    int			s;
+    int			i;
+
+    portals = Z_Malloc(numlines * sizeof(*portals), PU_STATIC, NULL);
+    numportals = 0;
+
+    for (i = 0, line = lines; i < numlines; ++i, ++line)
+    {
+	// As P_CrossSubsector, heights aside. Lines with the same sector
+	//  on both sides don't get in the way at all.
+
+	if (line->backsector == NULL
+	 || !(line->flags & ML_TWOSIDED)
+	 || line->frontsector == line->backsector)
+	    continue;
+
+	portal = &portals[numportals++];
+	portal->front = line->frontsector - sectors;
+	portal->back = line->backsector - sectors;
+
+	// Lengthen it by PVS_SLACK at each end.
+
+	dx = (double) line->dx / FRACUNIT;
+	dy = (double) line->dy / FRACUNIT;
+	len = (dx < 0 ? -dx : dx) > (dy < 0 ? -dy : dy)
+	    ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy);
+
+	if (len == 0)
+	    len = 1;
+
+	dx = dx * PVS_SLACK / len;
+	dy = dy * PVS_SLACK / len;
+
+	portal->seg.x1 = (double) line->v1->x / FRACUNIT - dx;
+	portal->seg.y1 = (double) line->v1->y / FRACUNIT - dy;
+	portal->seg.x2 = (double) line->v2->x / FRACUNIT + dx;
+	portal->seg.y2 = (double) line->v2->y / FRACUNIT + dy;
+    }
+
+    portalstart = Z_Malloc((numsectors + 1) * sizeof(int), PU_STATIC, NULL);
+    sectorportals = Z_Malloc((numportals * 2 + 1) * sizeof(int),
+                             PU_STATIC, NULL);
+
+    memset(portalstart, 0, (numsectors + 1) * sizeof(int));
+
+    for (i = 0; i < numportals; ++i)
+    {
+	++portalstart[portals[i].front + 1];
+	++portalstart[portals[i].back + 1];
+    }
+
+    for (s = 0; s < numsectors; ++s)
+    {
+	portalstart[s + 1] += portalstart[s];
+    }
+
+    for (i = 0; i < numportals; ++i)
+    {
+	sectorportals[portalstart[portals[i].front]++] = i;
+	sectorportals[portalstart[portals[i].back]++] = i;
+    }
+
+    // Filling the lists moved each start on to the next one.
+
+    for (s = numsectors; s > 0; --s)
+    {
+	portalstart[s] = portalstart[s - 1];
+    }
+
+    portalstart[0] = 0;
+}
+
+static void BuildPVS (void)
+{
+    int		s1;
+    int		s2;
+    int		pnum;
+
+    FindPortals();
+
+    inflow = Z_Malloc(numportals + 1, PU_STATIC, NULL);
+    visible = Z_Malloc(numsectors, PU_STATIC, NULL);
+    memset(inflow, 0, numportals + 1);
+
+    memset(pvsmatrix, 0, (numsectors * numsectors + 7) / 8);
+    numoverflows = 0;
+
+    for (s1 = 0; s1 < numsectors; ++s1)
+    {
+	SectorVisibility(s1);
+
+	for (s2 = 0; s2 < numsectors; ++s2)
+	{
+	    if (!visible[s2])
+	    {
+		pnum = s1 * numsectors + s2;
+		pvsmatrix[pnum >> 3] |= 1 << (pnum & 7);
+	    }
+	}
+    }
+
+    // Sight goes both ways, so only keep what both directions agree
+    //  can't be seen.
+
+    for (s1 = 0; s1 < numsectors; ++s1)
+    {
+	for (s2 = s1 + 1; s2 < numsectors; ++s2)
+	{
+	    int p1 = s1 * numsectors + s2;
+	    int p2 = s2 * numsectors + s1;
+	    int both = (pvsmatrix[p1 >> 3] >> (p1 & 7))
+	             & (pvsmatrix[p2 >> 3] >> (p2 & 7)) & 1;
+
+	    pvsmatrix[p1 >> 3] &= ~(1 << (p1 & 7));
+	    pvsmatrix[p2 >> 3] &= ~(1 << (p2 & 7));
+	    pvsmatrix[p1 >> 3] |= both << (p1 & 7);
+	    pvsmatrix[p2 >> 3] |= both << (p2 & 7);
+	}
+    }
+
+    Z_Free(visible);
+    Z_Free(inflow);
+    Z_Free(sectorportals);
+    Z_Free(portalstart);
+    Z_Free(portals);
+}
+
+static void HashLump (sha1_context_t *context, int lump)
+{
+    SHA1_UpdateInt32(context, W_LumpLength(lump));
+    SHA1_Update(context, W_CacheLumpNum(lump, PU_STATIC),
+                W_LumpLength(lump));
+    W_ReleaseLumpNum(lump);
+}
+
+// The PVS depends on the lines, their sides and the vertexes, and on
+//  this code.
+
+static void PVSCacheKey (int lumpnum, sha1_digest_t key)
+{
+    sha1_context_t	context;
+
+    SHA1_Init(&context);
+    SHA1_UpdateInt32(&context, PVSCACHE_VERSION);
+    SHA1_UpdateInt32(&context, numsectors);
+    HashLump(&context, lumpnum + ML_LINEDEFS);
+    HashLump(&context, lumpnum + ML_SIDEDEFS);
+    HashLump(&context, lumpnum + ML_VERTEXES);
+    SHA1_Final(key, &context);
+}
+
+static char *PVSCacheFilename (sha1_digest_t key)
+{
+    char	name[32];
+    int		i;
+
+    M_StringCopy(name, "pvs-", sizeof(name));
+
+    for (i = 0; i < 8; ++i)
+    {
+	M_snprintf(name + 4 + i * 2, sizeof(name) - 4 - i * 2,
+	           "%02x", key[i]);
+    }
+
+    M_StringConcat(name, ".cache", sizeof(name));
+
+    if (!strcmp(configdir, ""))
+	return M_StringDuplicate(name);
+
+    return M_StringJoin(configdir, DIR_SEPARATOR_S, name, NULL);
+}
+
+static boolean ReadPVSCache (char *filename, sha1_digest_t key, int size)
+{
+    pvscache_header_t	header;
+    boolean		result;
+    FILE*		f;
+
+    f = fopen(filename, "rb");
+
+    if (f == NULL)
+	return false;
+
+    result = fread(&header, 1, sizeof(header), f) == sizeof(header)
+          && memcmp(header.magic, PVSCACHE_MAGIC, 8) == 0
+          && header.version == PVSCACHE_VERSION
+          && header.size == (int) sizeof(header) + size
+          && header.numsectors == numsectors
+          && memcmp(header.key, key, sizeof(sha1_digest_t)) == 0
+          && fread(pvsmatrix, 1, size, f) == (size_t) size;
+
+    fclose(f);
+
+    return result;
+}
+
+static void WritePVSCache (char *filename, sha1_digest_t key, int size)
+{
+    pvscache_header_t	header;
+    FILE*		f;
+
+    f = fopen(filename, "wb");
+
+    if (f == NULL)
+    {
+	printf("P_LoadPVS: failed to open %s\n", filename);
+	return;
+    }
+
+    // The size is filled in at the end, so that a file that didn't
+    //  get written completely won't be used.
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PVSCACHE_MAGIC, 8);
+    header.version = PVSCACHE_VERSION;
+    memcpy(header.key, key, sizeof(sha1_digest_t));
+    header.numsectors = numsectors;
+    fwrite(&header, 1, sizeof(header), f);
+    fwrite(pvsmatrix, 1, size, f);
+
+    header.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, 1, sizeof(header), f);
+
+    if (ferror(f))
+    {
+	printf("P_LoadPVS: failed to write %s\n", filename);
+    }
+
+    fclose(f);
+}
+
+//
+// P_LoadPVS
+//
+void P_LoadPVS (int lumpnum)
+{
+    sha1_digest_t	key;
+    char*		filename;
+    uint64_t		starttime;
+    boolean		cached;
+    int			size;
+    int			rejected;
+    int			i;
+
+    pvsmatrix = NULL;
+
+    if (!usepvs || G_DemoOrNetGame())
+	return;
+
+    starttime = I_GetTimeNS();
+    size = (numsectors * numsectors + 7) / 8;
+    pvsmatrix = Z_LevelMalloc(size);
+
+    PVSCacheKey(lumpnum, key);
+    filename = PVSCacheFilename(key);
+    cached = ReadPVSCache(filename, key, size);
+
+    if (!cached)
+    {
+	BuildPVS();
+	WritePVSCache(filename, key, size);
+    }
+
+    free(filename);
+
+    if (devparm)
+    {
+	rejected = 0;
+
+	for (i = 0; i < numsectors * numsectors; ++i)
+	{
+	    if ((pvsmatrix[i >> 3] >> (i & 7)) & 1)
+		++rejected;
+	}
+
+	printf("P_LoadPVS: %s in %.1f ms, %d of %d sector pairs "
+	       "can't see each other\n",
+	       cached ? "read" : "built",
+	       (I_GetTimeNS() - starttime) / 1000000.0,
+	       rejected, numsectors * numsectors);
+
+	// These went over PVS_MAXWORK or PVS_MAXDEPTH, which is what
+	//  makes a large map slow to build, and are taken to see
+	//  everything.
+
+	if (!cached && numoverflows > 0)
+	{
+	    printf("P_LoadPVS: %d of %d sectors hit the search limit\n",
+	           numoverflows, numsectors);
+	}
+    }
+}
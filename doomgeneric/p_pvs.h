@@ -0,0 +1,33 @@
+//
+// Copyright(C) 2025 Martin Atkins
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Sector potentially visible sets, built at level load for -pvs.
+//
+
+#ifndef __P_PVS__
+#define __P_PVS__
+
+#include "doomtype.h"
+
+// Laid out like REJECT, with a bit set for each pair of sectors that
+// can't see each other. NULL when not in use for this level.
+extern byte *pvsmatrix;
+
+// Called by P_Init.
+void P_InitPVS (void);
+
+// Called by P_SetupLevel once the map is loaded, with its marker lump.
+void P_LoadPVS (int lumpnum);
+
+#endif
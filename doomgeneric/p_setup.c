@@ -20,6 +20,7 @@
 
 
 #include <math.h>
+#include <stdlib.h>
 
 #include "z_zone.h"
 
@@ -31,10 +32,14 @@
 #include "g_game.h"
 
 #include "i_system.h"
+#include "i_timer.h"
+#include "w_file.h"
 #include "w_wad.h"
 
 #include "doomdef.h"
 #include "p_local.h"
+#include "p_prefetch.h"
+#include "p_pvs.h"
 
 #include "s_sound.h"
 
@@ -65,6 +70,7 @@ node_t*		nodes;
 
 int		numlines;
 line_t*		lines;
+linegeom_t*	linegeom;
 
 int		numsides;
 side_t*		sides;
@@ -81,14 +87,20 @@ static int      totallines;
 // Blockmap size.
 int		bmapwidth;
 int		bmapheight;	// size in mapblocks
-short*		blockmap;	// int for larger maps
+int		bmapshift = 7;	// log2 of MAPBLOCKUNITS
+int*		blockmap;	// int for larger maps
 // offsets in blockmap are from here
-short*		blockmaplump;		
+int*		blockmaplump;		
 // origin of block map
 fixed_t		bmaporgx;
 fixed_t		bmaporgy;
 // for thing chains
 mobj_t**	blocklinks;		
+blockcell_t*	blockcells;
+
+// Set by -blockmap and -blocksize.
+static boolean	rebuildblockmap;
+static int	rebuildshift = 7;
 
 
 // REJECT
@@ -127,7 +139,7 @@ void P_LoadVertexes (int lump)
     numvertexes = W_LumpLength (lump) / sizeof(mapvertex_t);
 
     // Allocate zone memory for buffer.
-    vertexes = Z_Malloc (numvertexes*sizeof(vertex_t),PU_LEVEL,0);	
+    vertexes = Z_LevelMalloc (numvertexes*sizeof(vertex_t));	
 
     // Load data into cache.
     data = W_CacheLumpNum (lump, PU_STATIC);
@@ -181,7 +193,7 @@ void P_LoadSegs (int lump)
     int                 sidenum;
 	
     numsegs = W_LumpLength (lump) / sizeof(mapseg_t);
-    segs = Z_Malloc (numsegs*sizeof(seg_t),PU_LEVEL,0);	
+    segs = Z_LevelMalloc (numsegs*sizeof(seg_t));	
     memset (segs, 0, numsegs*sizeof(seg_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -241,7 +253,7 @@ void P_LoadSubsectors (int lump)
     subsector_t*	ss;
 	
     numsubsectors = W_LumpLength (lump) / sizeof(mapsubsector_t);
-    subsectors = Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);	
+    subsectors = Z_LevelMalloc (numsubsectors*sizeof(subsector_t));	
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     ms = (mapsubsector_t *)data;
@@ -270,7 +282,7 @@ void P_LoadSectors (int lump)
     sector_t*		ss;
 	
     numsectors = W_LumpLength (lump) / sizeof(mapsector_t);
-    sectors = Z_Malloc (numsectors*sizeof(sector_t),PU_LEVEL,0);	
+    sectors = Z_LevelMalloc (numsectors*sizeof(sector_t));	
     memset (sectors, 0, numsectors*sizeof(sector_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -305,7 +317,7 @@ void P_LoadNodes (int lump)
     node_t*	no;
 	
     numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
-    nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);	
+    nodes = Z_LevelMalloc (numnodes*sizeof(node_t));	
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     mn = (mapnode_t *)data;
@@ -395,17 +407,20 @@ void P_LoadLineDefs (int lump)
     int			i;
     maplinedef_t*	mld;
     line_t*		ld;
+    linegeom_t*		lg;
     vertex_t*		v1;
     vertex_t*		v2;
 	
     numlines = W_LumpLength (lump) / sizeof(maplinedef_t);
-    lines = Z_Malloc (numlines*sizeof(line_t),PU_LEVEL,0);	
+    lines = Z_LevelMalloc (numlines*sizeof(line_t));	
     memset (lines, 0, numlines*sizeof(line_t));
+    linegeom = Z_LevelMalloc (numlines*sizeof(linegeom_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     mld = (maplinedef_t *)data;
     ld = lines;
-    for (i=0 ; i<numlines ; i++, mld++, ld++)
+    lg = linegeom;
+    for (i=0 ; i<numlines ; i++, mld++, ld++, lg++)
     {
 	ld->flags = SHORT(mld->flags);
 	ld->special = SHORT(mld->special);
@@ -449,6 +464,16 @@ void P_LoadLineDefs (int lump)
 	    ld->bbox[BOXTOP] = v1->y;
 	}
 
+	lg->x1 = v1->x;
+	lg->y1 = v1->y;
+	lg->x2 = v2->x;
+	lg->y2 = v2->y;
+	lg->dx = ld->dx;
+	lg->dy = ld->dy;
+	memcpy (lg->bbox, ld->bbox, sizeof(lg->bbox));
+	lg->slopetype = ld->slopetype;
+	lg->validcount = 0;
+
 	ld->sidenum[0] = SHORT(mld->sidenum[0]);
 	ld->sidenum[1] = SHORT(mld->sidenum[1]);
 
@@ -478,7 +503,7 @@ void P_LoadSideDefs (int lump)
     side_t*		sd;
 	
     numsides = W_LumpLength (lump) / sizeof(mapsidedef_t);
-    sides = Z_Malloc (numsides*sizeof(side_t),PU_LEVEL,0);	
+    sides = Z_LevelMalloc (numsides*sizeof(side_t));	
     memset (sides, 0, numsides*sizeof(side_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -499,40 +524,250 @@ void P_LoadSideDefs (int lump)
 
 
 //
-// P_LoadBlockMap
+// P_ReadBlockMap
+// Reads the map's BLOCKMAP lump, widening it to ints.
+// Returns false if there isn't one that can be used.
 //
-void P_LoadBlockMap (int lump)
+static boolean P_ReadBlockMap (int lump)
 {
-    int i;
-    int count;
-    int lumplen;
+    short*	data;
+    int		i;
+    int		count;
+    int		width;
+    int		height;
 
-    lumplen = W_LumpLength(lump);
-    count = lumplen / 2;
-	
-    blockmaplump = Z_Malloc(lumplen, PU_LEVEL, NULL);
-    W_ReadLump(lump, blockmaplump);
-    blockmap = blockmaplump + 4;
+    count = W_LumpLength(lump) / 2;
+
+    if (count < 4)
+	return false;
+
+    data = W_CacheLumpNum(lump, PU_STATIC);
+    width = SHORT(data[2]);
+    height = SHORT(data[3]);
+
+    if (width <= 0 || height <= 0 || count < 4 + width * height)
+    {
+	W_ReleaseLumpNum(lump);
+	return false;
+    }
+
+    blockmaplump = Z_LevelMalloc(count * sizeof(*blockmaplump));
 
     // Swap all short integers to native byte ordering.
-  
-    for (i=0; i<count; i++)
+    // The offsets and line numbers are read as unsigned,
+    // so that lumps of up to 128K can be used.
+
+    for (i=0; i<4; i++)
     {
-	blockmaplump[i] = SHORT(blockmaplump[i]);
+	blockmaplump[i] = SHORT(data[i]);
     }
-		
+
+    for ( ; i<count; i++)
+    {
+	blockmaplump[i] = (unsigned short) SHORT(data[i]);
+	if (blockmaplump[i] == 0xffff)
+	    blockmaplump[i] = -1;
+    }
+
+    W_ReleaseLumpNum(lump);
+
+    // A truncated lump has offsets past its end.
+
+    for (i=4; i<4+width*height; i++)
+    {
+	if (blockmaplump[i] >= count)
+	    return false;
+    }
+
     // Read the header
 
     bmaporgx = blockmaplump[0]<<FRACBITS;
     bmaporgy = blockmaplump[1]<<FRACBITS;
-    bmapwidth = blockmaplump[2];
-    bmapheight = blockmaplump[3];
+    bmapwidth = width;
+    bmapheight = height;
+    bmapshift = 7;
+    blockmap = blockmaplump + 4;
+
+    return true;
+}
+
+
+//
+// P_AddLineToBlocks
+// Counts the line in each mapblock it touches or, if fill is set,
+// adds it to their lists.
+//
+static void P_AddLineToBlocks (int linenum, int* counts, boolean fill)
+{
+    line_t*	ld;
+    int64_t	x1;
+    int64_t	y1;
+    int64_t	dx;
+    int64_t	dy;
+    int64_t	cx;
+    int64_t	cy;
+    int64_t	size;
+    int64_t	s[4];
+    int		xl;
+    int		xh;
+    int		yl;
+    int		yh;
+    int		bx;
+    int		by;
+    int		block;
+
+    ld = &lines[linenum];
+    size = 1 << bmapshift;
+
+    // In map units, from the blockmap origin.
+    x1 = (ld->v1->x - bmaporgx) >> FRACBITS;
+    y1 = (ld->v1->y - bmaporgy) >> FRACBITS;
+    dx = ld->dx >> FRACBITS;
+    dy = ld->dy >> FRACBITS;
+
+    xl = (ld->bbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+    xh = (ld->bbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+    yl = (ld->bbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+    yh = (ld->bbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
+
+    for (by=yl ; by<=yh ; by++)
+    {
+	for (bx=xl ; bx<=xh ; bx++)
+	{
+	    // Leave out the mapblocks that have all four corners
+	    // on the same side of the line. Touching counts.
+
+	    cx = ((int64_t) bx << bmapshift) - x1;
+	    cy = ((int64_t) by << bmapshift) - y1;
+
+	    s[0] = dx * cy - dy * cx;
+	    s[1] = dx * cy - dy * (cx + size);
+	    s[2] = dx * (cy + size) - dy * cx;
+	    s[3] = dx * (cy + size) - dy * (cx + size);
+
+	    if ((s[0] > 0 && s[1] > 0 && s[2] > 0 && s[3] > 0)
+	     || (s[0] < 0 && s[1] < 0 && s[2] < 0 && s[3] < 0))
+		continue;
+
+	    block = by*bmapwidth+bx;
+
+	    if (fill)
+		blockmaplump[blockmap[block] + counts[block]] = linenum;
+
+	    counts[block]++;
+	}
+    }
+}
+
+
+//
+// P_CreateBlockMap
+// Builds a blockmap from the linedefs, with mapblocks 1<<shift units
+// square. Unlike the ones in WADs, the lists don't start with line 0.
+//
+static void P_CreateBlockMap (int shift)
+{
+    fixed_t	minx;
+    fixed_t	miny;
+    fixed_t	maxx;
+    fixed_t	maxy;
+    int*	counts;
+    int		numblocks;
+    int		offset;
+    int		total;
+    int		i;
+
+    minx = maxx = vertexes[0].x;
+    miny = maxy = vertexes[0].y;
+
+    for (i=1 ; i<numvertexes ; i++)
+    {
+	if (vertexes[i].x < minx)
+	    minx = vertexes[i].x;
+	if (vertexes[i].x > maxx)
+	    maxx = vertexes[i].x;
+	if (vertexes[i].y < miny)
+	    miny = vertexes[i].y;
+	if (vertexes[i].y > maxy)
+	    maxy = vertexes[i].y;
+    }
+
+    // Leave a margin round the map, as the node builders do.
+
+    bmapshift = shift;
+    bmaporgx = (minx & ~(FRACUNIT-1)) - 8*FRACUNIT;
+    bmaporgy = (miny & ~(FRACUNIT-1)) - 8*FRACUNIT;
+    bmapwidth = ((maxx - bmaporgx) >> MAPBLOCKSHIFT) + 1;
+    bmapheight = ((maxy - bmaporgy) >> MAPBLOCKSHIFT) + 1;
+    numblocks = bmapwidth * bmapheight;
+
+    // Count the lines in each mapblock first, to lay out the lists.
+
+    counts = Z_Malloc(numblocks * sizeof(*counts), PU_STATIC, NULL);
+    memset(counts, 0, numblocks * sizeof(*counts));
+
+    for (i=0 ; i<numlines ; i++)
+	P_AddLineToBlocks (i, counts, false);
+
+    total = 4 + numblocks;
+    for (i=0 ; i<numblocks ; i++)
+	total += counts[i] + 1;
+
+    blockmaplump = Z_LevelMalloc(total * sizeof(*blockmaplump));
+    blockmaplump[0] = bmaporgx >> FRACBITS;
+    blockmaplump[1] = bmaporgy >> FRACBITS;
+    blockmaplump[2] = bmapwidth;
+    blockmaplump[3] = bmapheight;
+    blockmap = blockmaplump + 4;
+
+    offset = 4 + numblocks;
+    for (i=0 ; i<numblocks ; i++)
+    {
+	blockmap[i] = offset;
+	offset += counts[i];
+	blockmaplump[offset++] = -1;
+	counts[i] = 0;
+    }
+
+    for (i=0 ; i<numlines ; i++)
+	P_AddLineToBlocks (i, counts, true);
+
+    Z_Free(counts);
+}
+
+
+//
+// P_LoadBlockMap
+// Uses the map's BLOCKMAP lump, unless a new blockmap has
+// been asked for or the lump isn't usable. Needs the linedefs.
+//
+void P_LoadBlockMap (int lump)
+{
+    int count;
+
+    // Building a new one would change the playsim, so only
+    // do so for demos and netgames if the lump can't be used.
+
+    if (rebuildblockmap && !G_DemoOrNetGame())
+    {
+	P_CreateBlockMap (rebuildshift);
+    }
+    else if (!P_ReadBlockMap (lump))
+    {
+	fprintf(stderr, "P_LoadBlockMap: Building a new blockmap, "
+		"as the map's own is missing or truncated.\n");
+	P_CreateBlockMap (7);
+    }
 	
     // Clear out mobj chains
 
     count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
+    blocklinks = Z_LevelMalloc(count);
     memset(blocklinks, 0, count);
+
+    count = sizeof(*blockcells) * bmapwidth * bmapheight;
+    blockcells = Z_LevelMalloc(count);
+    memset(blockcells, 0, count);
 }
 
 
@@ -578,7 +813,7 @@ void P_GroupLines (void)
     }
 
     // build line tables for each sector	
-    linebuffer = Z_Malloc (totallines*sizeof(line_t *), PU_LEVEL, 0);
+    linebuffer = Z_LevelMalloc (totallines*sizeof(line_t *));
 
     for (i=0; i<numsectors; ++i)
     {
@@ -737,6 +972,72 @@ static void P_LoadReject(int lumpnum)
     }
 }
 
+//
+// P_LevelDataSize
+// Works out roughly how much the map's data will need once loaded,
+//  so that it can all be allocated together.
+//
+static int P_LevelDataSize (int lumpnum)
+{
+    short*	header;
+    int		numl;
+    int		size;
+
+    numl = W_LumpLength (lumpnum+ML_LINEDEFS) / sizeof(maplinedef_t);
+
+    size = W_LumpLength (lumpnum+ML_VERTEXES) / sizeof(mapvertex_t)
+	       * sizeof(vertex_t)
+	 + W_LumpLength (lumpnum+ML_SECTORS) / sizeof(mapsector_t)
+	       * sizeof(sector_t)
+	 + W_LumpLength (lumpnum+ML_SIDEDEFS) / sizeof(mapsidedef_t)
+	       * sizeof(side_t)
+	 + numl * (sizeof(line_t) + sizeof(linegeom_t))
+	 + W_LumpLength (lumpnum+ML_SSECTORS) / sizeof(mapsubsector_t)
+	       * sizeof(subsector_t)
+	 + W_LumpLength (lumpnum+ML_NODES) / sizeof(mapnode_t)
+	       * sizeof(node_t)
+	 + W_LumpLength (lumpnum+ML_SEGS) / sizeof(mapseg_t)
+	       * sizeof(seg_t)
+	 + W_LumpLength (lumpnum+ML_BLOCKMAP) * 2	// widened to ints
+	 + numl * 2 * sizeof(line_t *);		// the most P_GroupLines needs
+
+    // The blockmap's size is in its header.
+
+    if (W_LumpLength (lumpnum+ML_BLOCKMAP) >= 8)
+    {
+	header = W_CacheLumpNum (lumpnum+ML_BLOCKMAP, PU_STATIC);
+	size += SHORT(header[2]) * SHORT(header[3])
+	      * (sizeof(*blocklinks) + sizeof(*blockcells));
+	W_ReleaseLumpNum (lumpnum+ML_BLOCKMAP);
+    }
+
+    // Allow for the rounding up of each array.
+    return size + 16 * sizeof(void *);
+}
+
+//
+// P_MapLumpName
+// Sets lumpname (9 chars) to the name of the marker lump for a map.
+//
+void P_MapLumpName (int episode, int map, char *lumpname)
+{
+    if ( gamemode == commercial)
+    {
+	if (map<10)
+	    DEH_snprintf(lumpname, 9, "map0%i", map);
+	else
+	    DEH_snprintf(lumpname, 9, "map%i", map);
+    }
+    else
+    {
+	lumpname[0] = 'E';
+	lumpname[1] = '0' + episode;
+	lumpname[2] = 'M';
+	lumpname[3] = '0' + map;
+	lumpname[4] = 0;
+    }
+}
+
 //
 // P_SetupLevel
 //
@@ -750,6 +1051,16 @@ P_SetupLevel
     int		i;
     char	lumpname[9];
     int		lumpnum;
+    int		maplumps[ML_BLOCKMAP+1];
+    uint64_t	starttime;
+    unsigned int startreads, startbytes;
+
+    starttime = I_GetTimeNS();
+    startreads = wad_reads;
+    startbytes = wad_read_bytes;
+
+    // Anything not prefetched yet will be loaded below as usual.
+    P_StopPrefetch ();
 	
     totalkills = totalitems = totalsecret = wminfo.maxfrags = 0;
     wminfo.partime = 180;
@@ -772,39 +1083,35 @@ P_SetupLevel
     P_InitThinkers ();
 	   
     // find map name
-    if ( gamemode == commercial)
-    {
-	if (map<10)
-	    DEH_snprintf(lumpname, 9, "map0%i", map);
-	else
-	    DEH_snprintf(lumpname, 9, "map%i", map);
-    }
-    else
-    {
-	lumpname[0] = 'E';
-	lumpname[1] = '0' + episode;
-	lumpname[2] = 'M';
-	lumpname[3] = '0' + map;
-	lumpname[4] = 0;
-    }
+    P_MapLumpName (episode, map, lumpname);
+    Z_StatsLevel (lumpname);
 
     lumpnum = W_GetNumForName (lumpname);
+
+    // Read all of the map's lumps together, ahead of loading them.
+    for (i=0 ; i<=ML_BLOCKMAP && lumpnum+i<numlumps ; i++)
+	maplumps[i] = lumpnum + i;
+    W_CacheLumpBatch (maplumps, i, PU_CACHE);
+
+    // Keep the level's geometry together.
+    Z_LevelReserve (P_LevelDataSize (lumpnum));
 	
     leveltime = 0;
 	
     // note: most of this ordering is important	
-    P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
     P_LoadVertexes (lumpnum+ML_VERTEXES);
     P_LoadSectors (lumpnum+ML_SECTORS);
     P_LoadSideDefs (lumpnum+ML_SIDEDEFS);
 
     P_LoadLineDefs (lumpnum+ML_LINEDEFS);
+    P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
     P_LoadSubsectors (lumpnum+ML_SSECTORS);
     P_LoadNodes (lumpnum+ML_NODES);
     P_LoadSegs (lumpnum+ML_SEGS);
 
     P_GroupLines ();
     P_LoadReject (lumpnum+ML_REJECT);
+    P_LoadPVS (lumpnum);
 
     bodyqueslot = 0;
     deathmatch_p = deathmatchstarts;
@@ -837,6 +1144,14 @@ P_SetupLevel
 
     //printf ("free memory: 0x%x\n", Z_FreeMemory());
 
+    if (devparm)
+    {
+	printf ("P_SetupLevel: %s loaded in %.1f ms, "
+		"%u WAD reads (%u bytes)\n",
+		lumpname, (I_GetTimeNS() - starttime) / 1000000.0,
+		wad_reads - startreads, wad_read_bytes - startbytes);
+    }
+
 }
 
 
@@ -846,8 +1161,42 @@ P_SetupLevel
 //
 void P_Init (void)
 {
+    int		p;
+
+    //!
+    // @category obscure
+    //
+    // Build a new blockmap from the linedefs when a level is loaded,
+    // rather than using its BLOCKMAP lump, which in large PWAD maps
+    // can be bloated or truncated. Not used in demos or netgames.
+    //
+
+    rebuildblockmap = M_CheckParm("-blockmap") > 0;
+
+    //!
+    // @category obscure
+    // @arg <units>
+    //
+    // With -blockmap, make the mapblocks this size instead of 128
+    // units. It must be a power of two from 32 to 1024.
+    //
+
+    p = M_CheckParmWithArgs("-blocksize", 1);
+    if (p > 0)
+    {
+	for (rebuildshift = 5 ; rebuildshift <= 10 ; rebuildshift++)
+	    if (atoi(myargv[p+1]) == 1 << rebuildshift)
+		break;
+
+	if (rebuildshift > 10)
+	    I_Error("P_Init: -blocksize must be a power of two "
+		    "from 32 to 1024");
+    }
+
     P_InitSwitchList ();
     P_InitPicAnims ();
+    P_InitSight ();
+    P_InitPVS ();
     R_InitSprites (sprnames);
 }
 
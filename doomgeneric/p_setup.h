@@ -31,6 +31,9 @@ P_SetupLevel
   int		playermask,
   skill_t	skill);
 
+// Name of the marker lump for a map, into a 9 char buffer.
+void P_MapLumpName (int episode, int map, char *lumpname);
+
 // Called by startup code.
 void P_Init (void);
 
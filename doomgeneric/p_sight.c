@@ -21,7 +21,10 @@
 #include "doomdef.h"
 
 #include "i_system.h"
+#include "m_argv.h"
+#include "m_profile.h"
 #include "p_local.h"
+#include "p_pvs.h"
 
 // State.
 #include "r_state.h"
@@ -39,6 +42,63 @@ fixed_t		t2y;
 
 int		sightcounts[2];
 
+//
+// SIGHT CACHE
+// Monsters check sight to the same targets several times a tic, from
+//  A_Look, A_Chase, P_CheckMissileRange and their attacks. The BSP
+//  traversal result only depends on where the two are and on the
+//  sector heights, so it is kept for the rest of the tic, or until
+//  P_ChangeSector moves a floor or ceiling. Nothing else depends on
+//  the traversal, so this doesn't affect demo sync.
+//
+#define SIGHTCACHESIZE	512
+
+typedef struct
+{
+    unsigned int	generation;
+    fixed_t		x1, y1, z1, height1;
+    fixed_t		x2, y2, z2, height2;
+    boolean		visible;
+} sightcache_t;
+
+static sightcache_t	sightcache[SIGHTCACHESIZE];
+
+// Entries from an earlier generation are out of date.
+static unsigned int	sightgeneration = 1;
+
+static boolean		nosightcache;
+
+int		sightcachecounts[2];
+
+void P_InitSight (void)
+{
+    //!
+    // @category obscure
+    //
+    // Don't keep the results of line of sight checks for the rest of
+    // the tic.
+    //
+
+    nosightcache = M_CheckParm("-nosightcache") > 0;
+}
+
+void P_ClearSightCache (void)
+{
+    ++sightgeneration;
+}
+
+static sightcache_t *SightCacheEntry (mobj_t* t1, mobj_t* t2)
+{
+    unsigned int	hash;
+
+    hash = (t1->x >> FRACBITS) * 31 + (t1->y >> FRACBITS);
+    hash = hash * 31 + (t2->x >> FRACBITS);
+    hash = hash * 31 + (t2->y >> FRACBITS);
+    hash ^= hash >> 9;
+
+    return &sightcache[hash & (SIGHTCACHESIZE - 1)];
+}
+
 
 //
 // P_DivlineSide
@@ -307,7 +367,11 @@ P_CheckSight
     int		pnum;
     int		bytenum;
     int		bitnum;
+    boolean	visible;
+    sightcache_t* entry;
     
+    PROFILE_BEGIN(PROF_CHECKSIGHT);
+
     // First check for trivial rejection.
 
     // Determine subsector entries in REJECT table.
@@ -323,13 +387,39 @@ P_CheckSight
 	sightcounts[0]++;
 
 	// can't possibly be connected
+	PROFILE_END(PROF_CHECKSIGHT);
 	return false;	
     }
 
+    // The PVS rules out more, where it's in use.
+    if (pvsmatrix != NULL && (pvsmatrix[bytenum]&bitnum))
+    {
+	sightcounts[0]++;
+
+	PROFILE_END(PROF_CHECKSIGHT);
+	return false;
+    }
+
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 
+    entry = SightCacheEntry (t1, t2);
+
+    if (!nosightcache
+     && entry->generation == sightgeneration
+     && entry->x1 == t1->x && entry->y1 == t1->y
+     && entry->z1 == t1->z && entry->height1 == t1->height
+     && entry->x2 == t2->x && entry->y2 == t2->y
+     && entry->z2 == t2->z && entry->height2 == t2->height)
+    {
+	sightcachecounts[0]++;
+	PROFILE_END(PROF_CHECKSIGHT);
+	return entry->visible;
+    }
+
+    sightcachecounts[1]++;
+
     validcount++;
 	
     sightzstart = t1->z + t1->height - (t1->height>>2);
@@ -344,7 +434,21 @@ P_CheckSight
     strace.dy = t2->y - t1->y;
 
     // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    visible = P_CrossBSPNode (numnodes-1);
+
+    entry->generation = sightgeneration;
+    entry->x1 = t1->x;
+    entry->y1 = t1->y;
+    entry->z1 = t1->z;
+    entry->height1 = t1->height;
+    entry->x2 = t2->x;
+    entry->y2 = t2->y;
+    entry->z2 = t2->z;
+    entry->height2 = t2->height;
+    entry->visible = visible;
+
+    PROFILE_END(PROF_CHECKSIGHT);
+    return visible;
 }
 
 
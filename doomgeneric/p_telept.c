@@ -70,9 +70,9 @@ EV_Teleport
     {
 	if (sectors[ i ].tag == tag )
 	{
-	    thinker = thinkercap.next;
-	    for (thinker = thinkercap.next;
-		 thinker != &thinkercap;
+	    thinker = thinkerclasscap[th_mobj].next;
+	    for (thinker = thinkerclasscap[th_mobj].next;
+		 thinker != &thinkerclasscap[th_mobj];
 		 thinker = thinker->next)
 	    {
 		// not a mobj
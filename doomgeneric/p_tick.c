@@ -18,7 +18,10 @@
 //
 
 
+#include <limits.h>
+
 #include "z_zone.h"
+#include "m_profile.h"
 #include "p_local.h"
 
 #include "doomstat.h"
@@ -36,8 +39,31 @@ int	leveltime;
 
 
 
-// Both the head and tail of the thinker list.
-thinker_t	thinkercap;
+// Both the head and tail of each thinker list.
+thinker_t	thinkerclasscap[NUMTHINKERCLASSES];
+
+// Sequence number for the next thinker added.
+static int	thinkerseq;
+
+// Each list's thinkers come from a pool, big enough for the largest
+// kind of thinker that goes in that list.
+zpool_t		thinkerpools[NUMTHINKERCLASSES];
+
+typedef union
+{
+    fireflicker_t	flicker;
+    lightflash_t	flash;
+    strobe_t		strobe;
+    glow_t		glow;
+} lightthinker_t;
+
+typedef union
+{
+    ceiling_t		ceiling;
+    vldoor_t		door;
+    floormove_t		floor;
+    plat_t		plat;
+} moverthinker_t;
 
 
 //
@@ -45,7 +71,21 @@ thinker_t	thinkercap;
 //
 void P_InitThinkers (void)
 {
-    thinkercap.prev = thinkercap.next  = &thinkercap;
+    int		i;
+
+    for (i = 0; i < NUMTHINKERCLASSES; i++)
+	thinkerclasscap[i].prev = thinkerclasscap[i].next = &thinkerclasscap[i];
+
+    thinkerseq = 0;
+
+    // The pools are emptied by Z_FreeTags along with the rest of the
+    // level, so they only need setting up once.
+    if (thinkerpools[th_mobj].size == 0)
+    {
+	Z_PoolInit (&thinkerpools[th_mobj], sizeof(mobj_t), 64);
+	Z_PoolInit (&thinkerpools[th_light], sizeof(lightthinker_t), 32);
+	Z_PoolInit (&thinkerpools[th_mover], sizeof(moverthinker_t), 32);
+    }
 }
 
 
@@ -53,14 +93,18 @@ void P_InitThinkers (void)
 
 //
 // P_AddThinker
-// Adds a new thinker at the end of the list.
+// Adds a new thinker at the end of its class's list.
 //
-void P_AddThinker (thinker_t* thinker)
+void P_AddThinker (thinker_t* thinker, thinkerlist_t list)
 {
-    thinkercap.prev->next = thinker;
-    thinker->next = &thinkercap;
-    thinker->prev = thinkercap.prev;
-    thinkercap.prev = thinker;
+    thinker_t*	cap = &thinkerclasscap[list];
+
+    cap->prev->next = thinker;
+    thinker->next = cap;
+    thinker->prev = cap->prev;
+    cap->prev = thinker;
+
+    thinker->seq = thinkerseq++;
 }
 
 
@@ -80,37 +124,138 @@ void P_RemoveThinker (thinker_t* thinker)
 
 //
 // P_AllocateThinker
-// Allocates memory and adds a new thinker at the end of the list.
+// Allocates memory for a thinker to go in the given list, which is
+// freed again once it has been removed and its thinking turn comes up.
+//
+void* P_AllocateThinker2 (thinkerlist_t list, const char* file, int line)
+{
+    return Z_PoolMalloc2 (&thinkerpools[list], file, line);
+}
+
+
+
+//
+// P_FreeThinker
 //
-void P_AllocateThinker (thinker_t*	thinker)
+void P_FreeThinker (thinker_t* thinker, thinkerlist_t list)
 {
+    Z_PoolFree (&thinkerpools[list], thinker);
+}
+
+
+
+//
+// P_StartThinkers
+// P_NextThinker
+// Walk the thinkers of every class in the order they were added in,
+// as if they were all still in the one list.  The thinker returned
+// may be freed before asking for the next one.
+//
+void P_StartThinkers (thinkeriter_t* iter)
+{
+    int		i;
+
+    for (i = 0; i < NUMTHINKERCLASSES; i++)
+	iter->next[i] = thinkerclasscap[i].next;
+}
+
+thinker_t* P_NextThinker (thinkeriter_t* iter)
+{
+    thinker_t*	th;
+    int		best;
+    int		i;
+
+    best = -1;
+    for (i = 0; i < NUMTHINKERCLASSES; i++)
+    {
+	if (iter->next[i] != &thinkerclasscap[i]
+	    && (best < 0 || iter->next[i]->seq < iter->next[best]->seq))
+	    best = i;
+    }
+
+    if (best < 0)
+	return NULL;
+
+    th = iter->next[best];
+    iter->next[best] = th->next;
+    return th;
 }
 
 
 
 //
 // P_RunThinkers
+// Runs each class's list in turn for as long as its thinkers come
+// before those left in every other list, so that they all still run
+// in the order they were added in.  Anything added while running goes
+// after everything already there, so the order only needs working out
+// again when that happens.
 //
 void P_RunThinkers (void)
 {
+    thinker_t*	last[NUMTHINKERCLASSES];
     thinker_t*	currentthinker;
+    thinker_t*	cap;
+    int		best;
+    int		limit;
+    int		seq;
+    int		i;
+
+    // The last thinker run in each list, so that anything added to it
+    // after the list was finished is still found.
+    for (i = 0; i < NUMTHINKERCLASSES; i++)
+	last[i] = &thinkerclasscap[i];
 
-    currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap)
+    while (1)
     {
-	if ( currentthinker->function.acv == (actionf_v)(-1) )
+	best = -1;
+	limit = INT_MAX;
+
+	for (i = 0; i < NUMTHINKERCLASSES; i++)
 	{
-	    // time to remove it
-	    currentthinker->next->prev = currentthinker->prev;
-	    currentthinker->prev->next = currentthinker->next;
-	    Z_Free (currentthinker);
+	    if (last[i]->next == &thinkerclasscap[i])
+		continue;
+
+	    seq = last[i]->next->seq;
+	    if (best < 0 || seq < last[best]->next->seq)
+	    {
+		if (best >= 0)
+		    limit = last[best]->next->seq;
+		best = i;
+	    }
+	    else if (seq < limit)
+	    {
+		limit = seq;
+	    }
 	}
-	else
+
+	if (best < 0)
+	    break;
+
+	cap = &thinkerclasscap[best];
+	seq = thinkerseq;
+	currentthinker = last[best]->next;
+
+	while (currentthinker != cap && currentthinker->seq < limit)
 	{
-	    if (currentthinker->function.acp1)
-		currentthinker->function.acp1 (currentthinker);
+	    if ( currentthinker->function.acv == (actionf_v)(-1) )
+	    {
+		// time to remove it
+		currentthinker->next->prev = currentthinker->prev;
+		currentthinker->prev->next = currentthinker->next;
+		P_FreeThinker (currentthinker, best);
+	    }
+	    else
+	    {
+		if (currentthinker->function.acp1)
+		    currentthinker->function.acp1 (currentthinker);
+		last[best] = currentthinker;
+	    }
+	    currentthinker = last[best]->next;
+
+	    if (thinkerseq != seq)
+		break;
 	}
-	currentthinker = currentthinker->next;
     }
 }
 
@@ -138,11 +283,16 @@ void P_Ticker (void)
     }
     
 		
+    // Sight checks are only kept for one tic.
+    P_ClearSightCache ();
+
     for (i=0 ; i<MAXPLAYERS ; i++)
 	if (playeringame[i])
 	    P_PlayerThink (&players[i]);
 			
+    PROFILE_BEGIN(PROF_RUNTHINKERS);
     P_RunThinkers ();
+    PROFILE_END(PROF_RUNTHINKERS);
     P_UpdateSpecials ();
     P_RespawnSpecials ();
 
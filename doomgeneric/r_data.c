@@ -18,21 +18,29 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "deh_main.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "sha1.h"
 #include "z_zone.h"
 
 
+#include "w_checksum.h"
 #include "w_wad.h"
 
 #include "doomdef.h"
+#include "m_argv.h"
+#include "m_config.h"
 #include "m_misc.h"
 #include "r_local.h"
 #include "p_local.h"
 
 #include "doomstat.h"
+#include "info.h"
 #include "r_sky.h"
 
 
@@ -243,6 +251,10 @@ void R_GenerateComposite (int texnum)
 		      PU_STATIC, 
 		      &texturecomposite[texnum]);	
 
+    // Parts of a column that no patch covers are drawn as they are,
+    //  so clear them rather than show whatever the zone left there.
+    memset (block, 0, texturecompositesize[texnum]);
+
     collump = texturecolumnlump[texnum];
     colofs = texturecolumnofs[texnum];
     
@@ -443,6 +455,406 @@ static void GenerateTextureHashTable(void)
 }
 
 
+
+//
+// STARTUP CACHE
+// R_InitTextures and R_InitSpriteLumps look at every patch and
+//  sprite in the WADs, and R_InitSpriteDefs at every sprite name,
+//  which makes up most of the startup time on slow storage.
+// The tables they build are saved in a cache file, keyed by the
+//  checksum of the WAD directory, the texture lumps and the size
+//  and time of each WAD file, and on the next run the whole
+//  file is read in one go and the tables used where they lie.
+//
+// The file is laid out in memory order for this build, which the
+//  key also covers, so a cache from another build is just rebuilt.
+//
+#define STARTCACHE_MAGIC	"DGSTCACH"
+#define STARTCACHE_VERSION	2
+
+typedef struct
+{
+    char		magic[8];
+    int			version;
+    int			size;
+    sha1_digest_t	key;
+    int			numtextures;
+    int			numspritelumps;
+    int			numsprites;
+} startcache_header_t;
+
+static boolean		nostartcache;
+static sha1_digest_t	startcache_key;
+
+// The loaded cache, and how far through it R_InitTextures,
+//  R_InitSpriteLumps and R_InitSpriteDefs have got.
+static byte*		startcache;
+static int		startcache_size;
+static int		startcache_pos;
+
+static char *StartCacheFilename (void)
+{
+    if (!strcmp(configdir, ""))
+	return M_StringDuplicate("startup.cache");
+
+    return M_StringJoin(configdir, DIR_SEPARATOR_S, "startup.cache", NULL);
+}
+
+// The directory checksum doesn't see a WAD edited in place, so
+//  hash the texture definitions themselves, and each file's size
+//  and modification time to catch changed patches and sprites.
+
+static void StartCacheAddLump (sha1_context_t *context, char *lumpname)
+{
+    int		lump;
+
+    lump = W_CheckNumForName(DEH_String(lumpname));
+
+    SHA1_UpdateInt32(context, lump);
+
+    if (lump >= 0)
+    {
+	SHA1_UpdateInt32(context, W_LumpLength(lump));
+	SHA1_Update(context, W_CacheLumpNum(lump, PU_STATIC),
+		    W_LumpLength(lump));
+	W_ReleaseLumpNum(lump);
+    }
+}
+
+static void StartCacheAddFile (sha1_context_t *context, char *filename)
+{
+    struct stat	st;
+
+    SHA1_UpdateString(context, filename);
+
+    if (stat(filename, &st) == 0)
+    {
+	SHA1_Update(context, (byte *) &st.st_size, sizeof(st.st_size));
+	SHA1_Update(context, (byte *) &st.st_mtime, sizeof(st.st_mtime));
+    }
+}
+
+static void StartCacheKey (sha1_digest_t key)
+{
+    sha1_context_t	context;
+    sha1_digest_t	wadsum;
+    char**		name;
+    int			i;
+
+    W_Checksum(wadsum);
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, wadsum, sizeof(wadsum));
+    SHA1_UpdateInt32(&context, STARTCACHE_VERSION);
+    SHA1_UpdateInt32(&context, sizeof(void *));
+    SHA1_UpdateInt32(&context, sizeof(texture_t));
+    SHA1_UpdateInt32(&context, sizeof(texpatch_t));
+    SHA1_UpdateInt32(&context, sizeof(spriteframe_t));
+    SHA1_UpdateInt32(&context, modifiedgame);
+
+    // Dehacked can rename the marker lumps and the sprites.
+    SHA1_UpdateString(&context, DEH_String("PNAMES"));
+    SHA1_UpdateString(&context, DEH_String("TEXTURE1"));
+    SHA1_UpdateString(&context, DEH_String("TEXTURE2"));
+    SHA1_UpdateString(&context, DEH_String("S_START"));
+    SHA1_UpdateString(&context, DEH_String("S_END"));
+
+    for (name = sprnames; *name != NULL; ++name)
+    {
+	SHA1_UpdateString(&context, DEH_String(*name));
+    }
+
+    StartCacheAddLump(&context, "PNAMES");
+    StartCacheAddLump(&context, "TEXTURE1");
+    StartCacheAddLump(&context, "TEXTURE2");
+
+    for (i = 0; i < numwadfiles; ++i)
+    {
+	StartCacheAddFile(&context, wadfilenames[i]);
+    }
+
+    SHA1_Final(key, &context);
+}
+
+// The size R_InitTextures allocates for a texture. A texture with no
+//  patches is shorter than texture_t, as in vanilla.
+
+static int StartCacheTextureSize (texture_t *texture)
+{
+    return sizeof(texture_t) + sizeof(texpatch_t)*(texture->patchcount-1);
+}
+
+// Take the next len bytes of the cache, or NULL if it's too short.
+
+static void *StartCacheTake (int len)
+{
+    void *result;
+
+    // Keep everything 8 byte aligned.
+    len = (len + 7) & ~7;
+
+    if (startcache_pos + len > startcache_size)
+    {
+	return NULL;
+    }
+
+    result = startcache + startcache_pos;
+    startcache_pos += len;
+
+    return result;
+}
+
+static void StartCachePut (FILE *f, void *data, int len)
+{
+    static byte padding[8];
+
+    fwrite(data, 1, len, f);
+    fwrite(padding, 1, ((len + 7) & ~7) - len, f);
+}
+
+static void R_ReadStartupCache (void)
+{
+    startcache_header_t *header;
+    char *filename;
+    FILE *f;
+    long length;
+
+    //!
+    // @category obscure
+    //
+    // Don't use or write the startup cache file, startup.cache, in
+    // the configuration directory.
+    //
+
+    nostartcache = M_CheckParm("-nostartcache") > 0;
+    if (nostartcache)
+    {
+	return;
+    }
+
+    StartCacheKey(startcache_key);
+
+    filename = StartCacheFilename();
+    f = fopen(filename, "rb");
+    free(filename);
+
+    if (f == NULL)
+    {
+	return;
+    }
+
+    length = M_FileLength(f);
+
+    if (length < (long) sizeof(startcache_header_t) || length > 0x10000000)
+    {
+	fclose(f);
+	return;
+    }
+
+    startcache = Z_Malloc(length, PU_STATIC, NULL);
+    startcache_size = fread(startcache, 1, length, f);
+    startcache_pos = 0;
+    fclose(f);
+
+    header = StartCacheTake(sizeof(startcache_header_t));
+
+    if (startcache_size != length
+     || memcmp(header->magic, STARTCACHE_MAGIC, 8) != 0
+     || header->version != STARTCACHE_VERSION
+     || header->size != length
+     || memcmp(header->key, startcache_key, sizeof(sha1_digest_t)) != 0)
+    {
+	Z_Free(startcache);
+	startcache = NULL;
+    }
+}
+
+// The header matched, but the rest doesn't fit with it, which should
+//  only happen if the file was damaged.
+
+static void StartCacheBad (void)
+{
+    I_Error("R_ReadStartupCache: startup.cache is damaged; "
+	    "delete it, or run with -nostartcache");
+}
+
+//
+// R_CachedTextures
+// Sets up the texture tables from the startup cache.
+//
+static void R_CachedTextures (void)
+{
+    startcache_header_t*	header;
+    texture_t*			texture;
+    int				i;
+    int				j;
+
+    header = (startcache_header_t *) startcache;
+    numtextures = header->numtextures;
+
+    textures = Z_Malloc (numtextures * sizeof(*textures), PU_STATIC, 0);
+    texturecolumnlump = Z_Malloc (numtextures * sizeof(*texturecolumnlump), PU_STATIC, 0);
+    texturecolumnofs = Z_Malloc (numtextures * sizeof(*texturecolumnofs), PU_STATIC, 0);
+    texturecomposite = Z_Malloc (numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
+    texturewidthmask = Z_Malloc (numtextures * sizeof(*texturewidthmask), PU_STATIC, 0);
+    textureheight = Z_Malloc (numtextures * sizeof(*textureheight), PU_STATIC, 0);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	// The patch count has to be looked at before the texture's
+	//  full size is known.
+	texture = (texture_t *) (startcache + startcache_pos);
+	if (startcache_pos + (int) sizeof(texture_t) > startcache_size
+	 || texture->patchcount < 0
+	 || StartCacheTake(StartCacheTextureSize(texture)) == NULL)
+	    StartCacheBad ();
+
+	textures[i] = texture;
+	texturecolumnlump[i] = StartCacheTake(texture->width*sizeof(**texturecolumnlump));
+	texturecolumnofs[i] = StartCacheTake(texture->width*sizeof(**texturecolumnofs));
+	texturecomposite[i] = 0;
+
+	if (texturecolumnlump[i] == NULL || texturecolumnofs[i] == NULL)
+	    StartCacheBad ();
+
+	j = 1;
+	while (j*2 <= texture->width)
+	    j<<=1;
+
+	texturewidthmask[i] = j-1;
+	textureheight[i] = texture->height<<FRACBITS;
+    }
+
+    texturecompositesize = StartCacheTake(numtextures * sizeof(*texturecompositesize));
+    if (texturecompositesize == NULL)
+	StartCacheBad ();
+
+    texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
+    
+    for (i=0 ; i<numtextures ; i++)
+	texturetranslation[i] = i;
+
+    GenerateTextureHashTable();
+}
+
+//
+// R_CachedSpriteDefs
+// Sets up the sprite definitions from the startup cache, if there
+//  is one, for R_InitSpriteDefs.
+//
+boolean R_CachedSpriteDefs (void)
+{
+    startcache_header_t*	header;
+    int*			numframes;
+    int				i;
+
+    if (startcache == NULL)
+	return false;
+
+    header = (startcache_header_t *) startcache;
+    numsprites = header->numsprites;
+    sprites = Z_Malloc(numsprites *sizeof(*sprites), PU_STATIC, NULL);
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	numframes = StartCacheTake(sizeof(int));
+	if (numframes == NULL)
+	    StartCacheBad ();
+
+	sprites[i].numframes = *numframes;
+	sprites[i].spriteframes =
+	    StartCacheTake(*numframes * sizeof(spriteframe_t));
+
+	if (sprites[i].spriteframes == NULL)
+	    StartCacheBad ();
+    }
+
+    return true;
+}
+
+//
+// R_WriteStartupCache
+// Called once the sprite definitions are set up, to save everything
+//  for next time if it didn't come from the cache.
+//
+void R_WriteStartupCache (void)
+{
+    startcache_header_t	header;
+    texture_t*		texture;
+    char*		filename;
+    FILE*		f;
+    int			i;
+
+    if (nostartcache || startcache != NULL)
+	return;
+
+    // A negative patch count can't be stored, so leave such WADs
+    //  to be loaded the slow way every time.
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (textures[i]->patchcount < 0)
+	    return;
+    }
+
+    filename = StartCacheFilename();
+    f = fopen(filename, "wb");
+
+    if (f == NULL)
+    {
+	printf("R_WriteStartupCache: failed to open %s\n", filename);
+	free(filename);
+	return;
+    }
+
+    // The size is filled in at the end, so that a file that didn't
+    //  get written completely won't be used.
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STARTCACHE_MAGIC, 8);
+    header.version = STARTCACHE_VERSION;
+    memcpy(header.key, startcache_key, sizeof(sha1_digest_t));
+    header.numtextures = numtextures;
+    header.numspritelumps = numspritelumps;
+    header.numsprites = numsprites;
+    StartCachePut(f, &header, sizeof(header));
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texture = textures[i];
+	StartCachePut(f, texture, StartCacheTextureSize(texture));
+	StartCachePut(f, texturecolumnlump[i],
+		      texture->width*sizeof(**texturecolumnlump));
+	StartCachePut(f, texturecolumnofs[i],
+		      texture->width*sizeof(**texturecolumnofs));
+    }
+
+    StartCachePut(f, texturecompositesize,
+		  numtextures * sizeof(*texturecompositesize));
+
+    StartCachePut(f, spritewidth, numspritelumps*sizeof(*spritewidth));
+    StartCachePut(f, spriteoffset, numspritelumps*sizeof(*spriteoffset));
+    StartCachePut(f, spritetopoffset, numspritelumps*sizeof(*spritetopoffset));
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	StartCachePut(f, &sprites[i].numframes, sizeof(int));
+	StartCachePut(f, sprites[i].spriteframes,
+		      sprites[i].numframes * sizeof(spriteframe_t));
+    }
+
+    header.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, 1, sizeof(header), f);
+
+    if (ferror(f))
+    {
+	printf("R_WriteStartupCache: failed to write %s\n", filename);
+    }
+
+    fclose(f);
+    free(filename);
+}
+
+
 //
 // R_InitTextures
 // Initializes the texture list
@@ -482,6 +894,11 @@ void R_InitTextures (void)
     int			temp2;
     int			temp3;
 
+    if (startcache != NULL)
+    {
+	R_CachedTextures ();
+	return;
+    }
     
     // Load the patch names from pnames.lmp.
     name[8] = 0;
@@ -655,12 +1072,30 @@ void R_InitFlats (void)
 void R_InitSpriteLumps (void)
 {
     int		i;
+    int		j;
+    int		batch[64];
     patch_t	*patch;
 	
     firstspritelump = W_GetNumForName (DEH_String("S_START")) + 1;
     lastspritelump = W_GetNumForName (DEH_String("S_END")) - 1;
     
     numspritelumps = lastspritelump - firstspritelump + 1;
+
+    if (startcache != NULL)
+    {
+	if (((startcache_header_t *) startcache)->numspritelumps != numspritelumps)
+	    StartCacheBad ();
+
+	spritewidth = StartCacheTake (numspritelumps*sizeof(*spritewidth));
+	spriteoffset = StartCacheTake (numspritelumps*sizeof(*spriteoffset));
+	spritetopoffset = StartCacheTake (numspritelumps*sizeof(*spritetopoffset));
+
+	if (spritetopoffset == NULL)
+	    StartCacheBad ();
+
+	return;
+    }
+
     spritewidth = Z_Malloc (numspritelumps*sizeof(*spritewidth), PU_STATIC, 0);
     spriteoffset = Z_Malloc (numspritelumps*sizeof(*spriteoffset), PU_STATIC, 0);
     spritetopoffset = Z_Malloc (numspritelumps*sizeof(*spritetopoffset), PU_STATIC, 0);
@@ -668,8 +1103,15 @@ void R_InitSpriteLumps (void)
     for (i=0 ; i< numspritelumps ; i++)
     {
 	if (!(i&63))
+	{
 	    printf (".");
 
+	    // Read the next 64 sprites together.
+	    for (j=0 ; j<64 && i+j<numspritelumps ; j++)
+		batch[j] = firstspritelump+i+j;
+	    W_CacheLumpBatch (batch, j, PU_CACHE);
+	}
+
 	patch = W_CacheLumpNum (firstspritelump+i, PU_CACHE);
 	spritewidth[i] = SHORT(patch->width)<<FRACBITS;
 	spriteoffset[i] = SHORT(patch->leftoffset)<<FRACBITS;
@@ -702,6 +1144,7 @@ void R_InitColormaps (void)
 //
 void R_InitData (void)
 {
+    R_ReadStartupCache ();
     printf ("R_InitTextures\n");
     R_InitTextures ();
     printf ("R_InitFlats\n");
@@ -791,41 +1234,49 @@ int	R_TextureNumForName (char* name)
 
 
 //
-// R_PrecacheLevel
-// Preloads all relevant graphics for the level.
+// R_PrecacheLumps
+// Lists the lumps needed to draw the flats, textures and sprites
+// marked in the given arrays, without duplicates. The list is
+// allocated with Z_Malloc, and *count is set to its length.
 //
 int		flatmemory;
 int		texturememory;
 int		spritememory;
 
-void R_PrecacheLevel (void)
+static int*		precachelumps;
+static int		numprecachelumps;
+static byte*		precachepresent;
+
+static void R_PrecacheLump (int lump)
 {
-    char*		flatpresent;
-    char*		texturepresent;
-    char*		spritepresent;
+    if (!precachepresent[lump])
+    {
+	precachepresent[lump] = 1;
+	precachelumps[numprecachelumps++] = lump;
+    }
+}
 
+int*
+R_PrecacheLumps
+( char*		flatpresent,
+  char*		texturepresent,
+  char*		spritepresent,
+  int*		count )
+{
     int			i;
     int			j;
     int			k;
     int			lump;
+    int*		result;
     
     texture_t*		texture;
-    thinker_t*		th;
     spriteframe_t*	sf;
 
-    if (demoplayback)
-	return;
-    
-    // Precache flats.
-    flatpresent = Z_Malloc(numflats, PU_STATIC, NULL);
-    memset (flatpresent,0,numflats);	
+    precachelumps = Z_Malloc(numlumps * sizeof(*precachelumps), PU_STATIC, NULL);
+    precachepresent = Z_Malloc(numlumps, PU_STATIC, NULL);
+    memset (precachepresent, 0, numlumps);
+    numprecachelumps = 0;
 
-    for (i=0 ; i<numsectors ; i++)
-    {
-	flatpresent[sectors[i].floorpic] = 1;
-	flatpresent[sectors[i].ceilingpic] = 1;
-    }
-	
     flatmemory = 0;
 
     for (i=0 ; i<numflats ; i++)
@@ -834,31 +1285,10 @@ void R_PrecacheLevel (void)
 	{
 	    lump = firstflat + i;
 	    flatmemory += lumpinfo[lump].size;
-	    W_CacheLumpNum(lump, PU_CACHE);
+	    R_PrecacheLump(lump);
 	}
     }
 
-    Z_Free(flatpresent);
-    
-    // Precache textures.
-    texturepresent = Z_Malloc(numtextures, PU_STATIC, NULL);
-    memset (texturepresent,0, numtextures);
-	
-    for (i=0 ; i<numsides ; i++)
-    {
-	texturepresent[sides[i].toptexture] = 1;
-	texturepresent[sides[i].midtexture] = 1;
-	texturepresent[sides[i].bottomtexture] = 1;
-    }
-
-    // Sky texture is always present.
-    // Note that F_SKY1 is the name used to
-    //  indicate a sky floor/ceiling as a flat,
-    //  while the sky texture is stored like
-    //  a wall texture, with an episode dependend
-    //  name.
-    texturepresent[skytexture] = 1;
-	
     texturememory = 0;
     for (i=0 ; i<numtextures ; i++)
     {
@@ -871,22 +1301,10 @@ void R_PrecacheLevel (void)
 	{
 	    lump = texture->patches[j].patch;
 	    texturememory += lumpinfo[lump].size;
-	    W_CacheLumpNum(lump , PU_CACHE);
+	    R_PrecacheLump(lump);
 	}
     }
 
-    Z_Free(texturepresent);
-    
-    // Precache sprites.
-    spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
-    memset (spritepresent,0, numsprites);
-	
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
-    {
-	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
-	    spritepresent[((mobj_t *)th)->sprite] = 1;
-    }
-	
     spritememory = 0;
     for (i=0 ; i<numsprites ; i++)
     {
@@ -900,12 +1318,90 @@ void R_PrecacheLevel (void)
 	    {
 		lump = firstspritelump + sf->lump[k];
 		spritememory += lumpinfo[lump].size;
-		W_CacheLumpNum(lump , PU_CACHE);
+		R_PrecacheLump(lump);
 	    }
 	}
     }
 
+    Z_Free(precachepresent);
+
+    result = precachelumps;
+    *count = numprecachelumps;
+    precachelumps = NULL;
+
+    return result;
+}
+
+
+//
+// R_PrecacheLevel
+// Preloads all relevant graphics for the level.
+//
+void R_PrecacheLevel (void)
+{
+    char*		flatpresent;
+    char*		texturepresent;
+    char*		spritepresent;
+    int*		lumps;
+    int			count;
+
+    int			i;
+    
+    thinker_t*		th;
+
+    if (demoplayback)
+	return;
+
+    // Precache flats.
+    flatpresent = Z_Malloc(numflats, PU_STATIC, NULL);
+    memset (flatpresent,0,numflats);	
+
+    for (i=0 ; i<numsectors ; i++)
+    {
+	flatpresent[sectors[i].floorpic] = 1;
+	flatpresent[sectors[i].ceilingpic] = 1;
+    }
+	
+    // Precache textures.
+    texturepresent = Z_Malloc(numtextures, PU_STATIC, NULL);
+    memset (texturepresent,0, numtextures);
+	
+    for (i=0 ; i<numsides ; i++)
+    {
+	texturepresent[sides[i].toptexture] = 1;
+	texturepresent[sides[i].midtexture] = 1;
+	texturepresent[sides[i].bottomtexture] = 1;
+    }
+
+    // Sky texture is always present.
+    // Note that F_SKY1 is the name used to
+    //  indicate a sky floor/ceiling as a flat,
+    //  while the sky texture is stored like
+    //  a wall texture, with an episode dependend
+    //  name.
+    texturepresent[skytexture] = 1;
+	
+    // Precache sprites.
+    spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
+    memset (spritepresent,0, numsprites);
+	
+    for (th = thinkerclasscap[th_mobj].next ; th != &thinkerclasscap[th_mobj] ; th=th->next)
+    {
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    spritepresent[((mobj_t *)th)->sprite] = 1;
+    }
+	
+    lumps = R_PrecacheLumps(flatpresent, texturepresent, spritepresent,
+                            &count);
+
+    Z_Free(flatpresent);
+    Z_Free(texturepresent);
     Z_Free(spritepresent);
+
+    // Now load everything, in the order it is in the WAD files.
+    W_CacheLumpBatch(lumps, count, PU_CACHE);
+
+    Z_Free(lumps);
 }
 
 
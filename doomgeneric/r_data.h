@@ -36,6 +36,19 @@ R_GetColumn
 void R_InitData (void);
 void R_PrecacheLevel (void);
 
+// Startup cache, for R_InitSprites.
+boolean R_CachedSpriteDefs (void);
+void R_WriteStartupCache (void);
+
+// The lumps needed for the marked flats, textures and sprites,
+// in a list allocated with Z_Malloc.
+int*
+R_PrecacheLumps
+( char*		flatpresent,
+  char*		texturepresent,
+  char*		spritepresent,
+  int*		count );
+
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
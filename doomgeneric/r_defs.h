@@ -122,6 +122,9 @@ typedef	struct
     // list of mobjs in sector
     mobj_t*	thinglist;
 
+    // list of mobjs whose bounding box touches the sector
+    struct msecnode_s*	touching_thinglist;
+
     // thinker_t for reversable actions
     void*	specialdata;
 
@@ -131,6 +134,25 @@ typedef	struct
 } sector_t;
 
 
+//
+// A thing touching a sector, linked into both the sector's list of
+// things and the thing's list of sectors.
+//
+typedef struct msecnode_s
+{
+    sector_t*		m_sector;
+    mobj_t*		m_thing;
+
+    // the other things touching the sector
+    struct msecnode_s*	m_tprev;
+    struct msecnode_s*	m_tnext;
+
+    // the other sectors the thing touches
+    struct msecnode_s*	m_snext;
+
+} msecnode_t;
+
+
 
 
 //
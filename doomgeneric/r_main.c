@@ -31,6 +31,7 @@
 
 #include "m_bbox.h"
 #include "m_menu.h"
+#include "m_profile.h"
 
 #include "r_local.h"
 #include "r_sky.h"
@@ -882,17 +883,23 @@ void R_RenderPlayerView (player_t* player)
     NetUpdate ();
 
     // The head node is the last node output.
+    PROFILE_BEGIN(PROF_RENDERBSPNODE);
     R_RenderBSPNode (numnodes-1);
+    PROFILE_END(PROF_RENDERBSPNODE);
     
     // Check for new console commands.
     NetUpdate ();
     
+    PROFILE_BEGIN(PROF_DRAWPLANES);
     R_DrawPlanes ();
+    PROFILE_END(PROF_DRAWPLANES);
     
     // Check for new console commands.
     NetUpdate ();
     
+    PROFILE_BEGIN(PROF_DRAWMASKED);
     R_DrawMasked ();
+    PROFILE_END(PROF_DRAWMASKED);
 
     // Check for new console commands.
     NetUpdate ();				
@@ -26,6 +26,13 @@
 
 
 // Visplane related.
+#define MAXVISPLANES	128
+#define MAXOPENINGS	SCREENWIDTH*64
+
+extern visplane_t	visplanes[MAXVISPLANES];
+extern visplane_t*	lastvisplane;
+
+extern short		openings[MAXOPENINGS];
 extern  short*		lastopening;
 
 
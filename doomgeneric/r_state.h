@@ -50,6 +50,8 @@ extern int		scaledviewwidth;
 extern int		viewheight;
 
 extern int		firstflat;
+extern int		numflats;
+extern int		numtextures;
 
 // for global animation
 extern int*		flattranslation;	
@@ -179,6 +179,9 @@ void R_InitSpriteDefs (char** namelist)
     int		end;
     int		patched;
 		
+    if (R_CachedSpriteDefs ())
+	return;
+
     // count the number of sprite names
     check = namelist;
     while (*check != NULL)
@@ -298,6 +301,7 @@ void R_InitSprites (char** namelist)
     }
 	
     R_InitSpriteDefs (namelist);
+    R_WriteStartupCache ();
 }
 
 
@@ -646,6 +646,22 @@ void S_ChangeMusic(int musicnum, int looping)
     mus_playing = music;
 }
 
+int S_ChannelsInUse(void)
+{
+    int cnum;
+    int inuse = 0;
+
+    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    {
+        if (channels[cnum].sfxinfo)
+        {
+            ++inuse;
+        }
+    }
+
+    return inuse;
+}
+
 boolean S_MusicPlaying(void)
 {
     return I_MusicIsPlaying();
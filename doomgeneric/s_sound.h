@@ -83,6 +83,9 @@ void S_UpdateSounds(mobj_t *listener);
 void S_SetMusicVolume(int volume);
 void S_SetSfxVolume(int volume);
 
+// Number of the snd_channels channels currently playing a sound.
+int S_ChannelsInUse(void);
+
 extern int snd_channels;
 
 #endif
@@ -38,8 +38,14 @@ extern wad_file_class_t win32_wad_file;
 extern wad_file_class_t posix_wad_file;
 #endif 
 
+// The last class is the default, and the others are only tried with
+// -mmap.
+
 static wad_file_class_t *wad_file_classes[] = 
 {
+#ifdef HAVE_MMAP
+    &posix_wad_file,
+#endif
 #ifdef RISCOVITE
     &riscovite_wad_file,
 #else
@@ -52,6 +58,16 @@ wad_file_t *W_OpenFile(char *path)
     wad_file_t *result;
     int i;
 
+    //!
+    // Use the OS's virtual memory subsystem to map WAD files
+    // directly into memory.
+    //
+
+    if (!M_CheckParm("-mmap"))
+    {
+        return wad_file_classes[arrlen(wad_file_classes) - 1]->OpenFile(path);
+    }
+
     // Try all classes in order until we find one that works
 
     result = NULL;
@@ -74,9 +90,15 @@ void W_CloseFile(wad_file_t *wad)
     wad->file_class->CloseFile(wad);
 }
 
+unsigned int wad_reads;
+unsigned int wad_read_bytes;
+
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len)
 {
+    ++wad_reads;
+    wad_read_bytes += buffer_len;
+
     return wad->file_class->Read(wad, offset, buffer, buffer_len);
 }
 
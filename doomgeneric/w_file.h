@@ -75,4 +75,9 @@ void W_CloseFile(wad_file_t *wad);
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len);
 
+// Number of W_Read calls, and the number of bytes asked for, so far.
+
+extern unsigned int wad_reads;
+extern unsigned int wad_read_bytes;
+
 #endif /* #ifndef __W_FILE__ */
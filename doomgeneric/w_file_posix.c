@@ -0,0 +1,217 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	WAD I/O functions.
+//
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+typedef struct
+{
+    wad_file_t wad;
+    int handle;
+} posix_wad_file_t;
+
+extern wad_file_class_t posix_wad_file;
+
+static void MapFile(posix_wad_file_t *wad, char *filename)
+{
+    void *result;
+    int protection;
+    int flags;
+
+    // Mapped area can be read and written to.  Ideally
+    // this should be read-only, as none of the Doom code should
+    // change the WAD files after being read.  However, there may
+    // be code lurking in the source that does.
+
+    protection = PROT_READ|PROT_WRITE;
+
+    // Writes to the mapped area result in private changes that are
+    // *not* written to disk.
+
+    flags = MAP_PRIVATE;
+
+    result = mmap(NULL, wad->wad.length,
+                  protection, flags,
+                  wad->handle, 0);
+
+    if (result == MAP_FAILED)
+    {
+        // Fall back to reading the file with W_POSIX_Read.
+
+        fprintf(stderr, "W_POSIX_OpenFile: Unable to mmap() %s - %s\n",
+                        filename, strerror(errno));
+        wad->wad.mapped = NULL;
+        return;
+    }
+
+    // Lumps are read in no particular order, and nearly all of them are
+    // needed sooner or later, so have the whole file read in the
+    // background now rather than one page fault at a time later.
+
+    madvise(result, wad->wad.length, MADV_WILLNEED);
+
+    wad->wad.mapped = result;
+}
+
+static unsigned int GetFileLength(int handle)
+{
+    struct stat st;
+
+    if (fstat(handle, &st) < 0)
+    {
+        return 0;
+    }
+
+    return st.st_size;
+}
+
+static wad_file_t *W_POSIX_OpenFile(char *path)
+{
+    posix_wad_file_t *result;
+    int handle;
+
+    handle = open(path, O_RDONLY);
+
+    if (handle < 0)
+    {
+        return NULL;
+    }
+
+    // Create a new posix_wad_file_t to hold the file handle.
+
+    result = Z_Malloc(sizeof(posix_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &posix_wad_file;
+    result->wad.mapped = NULL;
+    result->wad.length = GetFileLength(handle);
+    result->handle = handle;
+
+    // Try to map the file into memory with mmap:
+
+    if (result->wad.length > 0)
+    {
+        MapFile(result, path);
+    }
+
+    return &result->wad;
+}
+
+static void W_POSIX_CloseFile(wad_file_t *wad)
+{
+    posix_wad_file_t *posix_wad;
+
+    posix_wad = (posix_wad_file_t *) wad;
+
+    // If mapped, unmap it.
+
+    if (posix_wad->wad.mapped != NULL)
+    {
+        munmap(posix_wad->wad.mapped, posix_wad->wad.length);
+    }
+
+    // Close the file
+
+    close(posix_wad->handle);
+    Z_Free(posix_wad);
+}
+
+// Read data from the specified position in the file into the
+// provided buffer.  Returns the number of bytes read.
+
+static size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
+                           void *buffer, size_t buffer_len)
+{
+    posix_wad_file_t *posix_wad;
+    byte *byte_buffer;
+    size_t bytes_read;
+    ssize_t result;
+
+    posix_wad = (posix_wad_file_t *) wad;
+
+    // If mapped, the data is already there.
+
+    if (posix_wad->wad.mapped != NULL)
+    {
+        if (offset >= posix_wad->wad.length)
+        {
+            return 0;
+        }
+        if (buffer_len > posix_wad->wad.length - offset)
+        {
+            buffer_len = posix_wad->wad.length - offset;
+        }
+        memcpy(buffer, posix_wad->wad.mapped + offset, buffer_len);
+        return buffer_len;
+    }
+
+    // Read into the buffer.
+
+    bytes_read = 0;
+    byte_buffer = buffer;
+
+    while (buffer_len > 0)
+    {
+        result = pread(posix_wad->handle, byte_buffer, buffer_len,
+                       offset + bytes_read);
+
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            I_Error("W_POSIX_Read: Error reading from file");
+        }
+        else if (result == 0)
+        {
+            break;
+        }
+
+        // Successfully read some bytes
+
+        byte_buffer += result;
+        buffer_len -= result;
+        bytes_read += result;
+    }
+
+    return bytes_read;
+}
+
+
+wad_file_class_t posix_wad_file =
+{
+    W_POSIX_OpenFile,
+    W_POSIX_CloseFile,
+    W_POSIX_Read,
+};
+
+#endif /* #ifdef HAVE_MMAP */
+
@@ -17,37 +17,205 @@
 //
 
 #include <riscovite.h>
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
 
+#include "i_system.h"
 #include "m_misc.h"
 #include "w_file.h"
 #include "z_zone.h"
 
+// Every read is a seek and a read syscall, and a round trip to the
+// filesystem costs far more than copying the data, so reads go through
+// a small cache. Data is cached in runs of up to WAD_RUN_BLOCKS aligned
+// blocks, each filled with a single read, so that reading one small lump
+// also reads ahead the lumps that follow it, which level setup usually
+// asks for next.
+
+#define WAD_BLOCK_SIZE 4096
+#define WAD_RUN_BLOCKS 16
+#define WAD_RUN_SIZE (WAD_BLOCK_SIZE * WAD_RUN_BLOCKS)
+#define WAD_NUM_RUNS 4
+
 typedef struct
 {
     wad_file_t wad;
     uint64_t hnd;
+
+    // Where the next read will start from without seeking.
+    unsigned int position;
 } riscovite_wad_file_t;
 
+typedef struct
+{
+    riscovite_wad_file_t *file;     // NULL if unused
+    unsigned int offset;            // start, a multiple of WAD_BLOCK_SIZE
+    unsigned int length;            // bytes valid, short at end of file
+    unsigned int lastuse;
+    byte data[WAD_RUN_SIZE];
+} wad_run_t;
+
+static wad_run_t runs[WAD_NUM_RUNS];
+static unsigned int runs_clock;
+
+// Counters reported at exit, for tuning the sizes above.
+static unsigned int stat_hits;
+static unsigned int stat_misses;
+static unsigned int stat_direct;
+static unsigned int stat_syscalls;
+static uint64_t stat_bytes;
+
 extern wad_file_class_t riscovite_wad_file;
 
+static void W_Riscovite_PrintStats(void)
+{
+    printf("W_Riscovite: %u cached reads (%u%% hits), %u direct, "
+           "%u syscalls, %llu bytes read\n",
+           stat_hits + stat_misses,
+           stat_hits + stat_misses > 0
+               ? stat_hits * 100 / (stat_hits + stat_misses) : 0,
+           stat_direct, stat_syscalls, (unsigned long long) stat_bytes);
+}
+
+// Read straight from the file, skipping the seek if the file is already
+// at the right position.
+
+static size_t ReadFile(riscovite_wad_file_t *riscovite_wad,
+                       unsigned int offset, void *buffer, size_t buffer_len)
+{
+    struct riscovite_result_uint64 r_u64;
+
+    if (riscovite_wad->position != offset)
+    {
+        ++stat_syscalls;
+        r_u64 = riscovite_seek(riscovite_wad->hnd, offset, RISCOVITE_SEEK_SET);
+        if (r_u64.error != 0) {
+            fprintf(stderr, "failed to seek in WAD file: %s\n", strerror(r_u64.error));
+            riscovite_wad->position = UINT_MAX;
+            return 0;
+        }
+        if (r_u64.value != offset) {
+            fprintf(stderr, "failed to seek in WAD file: wanted offset %u, but ended up at %u\n",
+                    offset, (unsigned int) r_u64.value);
+            riscovite_wad->position = UINT_MAX;
+            return 0;
+        }
+    }
+
+    ++stat_syscalls;
+    r_u64 = riscovite_read(riscovite_wad->hnd, buffer, buffer_len);
+    if (r_u64.error != 0) {
+        fprintf(stderr, "failed to read from WAD file: %s\n", strerror(r_u64.error));
+        riscovite_wad->position = UINT_MAX;
+        return 0;
+    }
+
+    riscovite_wad->position = offset + r_u64.value;
+    stat_bytes += r_u64.value;
+
+    return (size_t)r_u64.value;
+}
+
+// Find the run holding the byte at offset, reading it in if necessary.
+
+static wad_run_t *GetRun(riscovite_wad_file_t *riscovite_wad,
+                         unsigned int offset)
+{
+    wad_run_t *run;
+    wad_run_t *victim;
+    unsigned int run_len;
+    int i;
+
+    victim = &runs[0];
+
+    for (i = 0; i < WAD_NUM_RUNS; ++i)
+    {
+        run = &runs[i];
+
+        if (run->file == riscovite_wad
+         && offset >= run->offset
+         && offset - run->offset < run->length)
+        {
+            ++stat_hits;
+            run->lastuse = ++runs_clock;
+            return run;
+        }
+
+        // Evict the least recently used run, or an unused one.
+
+        if (run->file == NULL
+         || (victim->file != NULL && run->lastuse < victim->lastuse))
+        {
+            victim = run;
+        }
+    }
+
+    ++stat_misses;
+
+    run = victim;
+    run->file = NULL;
+    run->offset = offset & ~(WAD_BLOCK_SIZE - 1);
+
+    run_len = WAD_RUN_SIZE;
+    if (riscovite_wad->wad.length > run->offset
+     && riscovite_wad->wad.length - run->offset < run_len)
+    {
+        run_len = riscovite_wad->wad.length - run->offset;
+    }
+
+    run->length = ReadFile(riscovite_wad, run->offset, run->data, run_len);
+    if (run->length <= offset - run->offset)
+    {
+        // Nothing there to read.
+        return NULL;
+    }
+
+    run->file = riscovite_wad;
+    run->lastuse = ++runs_clock;
+
+    return run;
+}
+
 static wad_file_t *W_Riscovite_OpenFile(char *path)
 {
+    static boolean stats_registered = false;
     riscovite_wad_file_t *result;
     struct riscovite_result_uint64 r_u64;
+    uint64_t hnd;
 
     r_u64 = riscovite_open(RISCOVITE_HND_CWD, path, RISCOVITE_OPEN_FILE | RISCOVITE_OPEN_TO_READ);
     if (r_u64.error != 0) {
         return NULL;
     }
+    hnd = r_u64.value;
 
     result = Z_Malloc(sizeof(riscovite_wad_file_t), PU_STATIC, 0);
     result->wad.file_class = &riscovite_wad_file;
     result->wad.mapped = NULL;
-    result->wad.length = 0; // TODO: Actually populate this, once RISCovite has an API for asking this question
-    result->hnd = r_u64.value;
-    
-    printf("opened %s as file number %d\n", path, result->hnd);
+    result->hnd = hnd;
+
+    // Seeking to the end tells us the length, which leaves us at the end
+    // so the first read will need to seek back.
+
+    r_u64 = riscovite_seek(hnd, 0, RISCOVITE_SEEK_END);
+    if (r_u64.error != 0 || r_u64.value > UINT_MAX) {
+        fprintf(stderr, "failed to find length of WAD file %s\n", path);
+        result->wad.length = 0;
+        result->position = UINT_MAX;
+    } else {
+        result->wad.length = (unsigned int) r_u64.value;
+        result->position = result->wad.length;
+    }
+
+    printf("opened %s as file number %d (%u bytes)\n", path, (int) result->hnd,
+           result->wad.length);
+
+    if (!stats_registered)
+    {
+        I_AtExit(W_Riscovite_PrintStats, false);
+        stats_registered = true;
+    }
 
     return &result->wad;
 }
@@ -55,8 +223,18 @@ static wad_file_t *W_Riscovite_OpenFile(char *path)
 static void W_Riscovite_CloseFile(wad_file_t *wad)
 {
     riscovite_wad_file_t *riscovite_wad;
+    int i;
+
     riscovite_wad = (riscovite_wad_file_t *) wad;
 
+    for (i = 0; i < WAD_NUM_RUNS; ++i)
+    {
+        if (runs[i].file == riscovite_wad)
+        {
+            runs[i].file = NULL;
+        }
+    }
+
     riscovite_close(riscovite_wad->hnd);
     Z_Free(riscovite_wad);
 }
@@ -67,32 +245,54 @@ static void W_Riscovite_CloseFile(wad_file_t *wad)
 size_t W_Riscovite_Read(wad_file_t *wad, unsigned int offset,
                    void *buffer, size_t buffer_len)
 {
-    struct riscovite_result_uint64 r_u64;
     riscovite_wad_file_t *riscovite_wad;
+    byte *byte_buffer;
+    size_t bytes_read;
+    wad_run_t *run;
+    unsigned int run_offset;
+    size_t len;
+
     riscovite_wad = (riscovite_wad_file_t *) wad;
 
-    // Jump to the specified position in the file.
-    r_u64 = riscovite_seek(riscovite_wad->hnd, offset, RISCOVITE_SEEK_SET);
-    if (r_u64.error != 0) {
-        fprintf(stderr, "failed to seek in WAD file: %s\n", strerror(r_u64.error));
-        return 0;
-    }
-    if (r_u64.value != offset) {
-        fprintf(stderr, "failed to seek in WAD file: wanted offset %d, but ended up at %d\n", offset, r_u64.value);
-        return 0;
-    }
+    // Reads as big as a whole run gain nothing from the cache, and would
+    // evict everything else from it.
 
-    // Read into the buffer.
-    r_u64 = riscovite_read(riscovite_wad->hnd, buffer, buffer_len);
-    if (r_u64.error != 0) {
-        fprintf(stderr, "failed to read from WAD file: %s\n", strerror(r_u64.error));
-        return 0;
+    if (buffer_len >= WAD_RUN_SIZE)
+    {
+        ++stat_direct;
+        bytes_read = ReadFile(riscovite_wad, offset, buffer, buffer_len);
+        if (bytes_read != buffer_len) {
+            fprintf(stderr, "short read from WAD file: want %u but got %u\n",
+                    (unsigned int) buffer_len, (unsigned int) bytes_read);
+        }
+        return bytes_read;
     }
-    if (r_u64.value != buffer_len) {
-        fprintf(stderr, "short read from WAD file: want %d but got %d\n", buffer_len, r_u64.value);
+
+    byte_buffer = buffer;
+    bytes_read = 0;
+
+    while (bytes_read < buffer_len)
+    {
+        run = GetRun(riscovite_wad, offset + bytes_read);
+        if (run == NULL)
+        {
+            fprintf(stderr, "short read from WAD file: want %u but got %u\n",
+                    (unsigned int) buffer_len, (unsigned int) bytes_read);
+            break;
+        }
+
+        run_offset = offset + bytes_read - run->offset;
+        len = run->length - run_offset;
+        if (len > buffer_len - bytes_read)
+        {
+            len = buffer_len - bytes_read;
+        }
+
+        memcpy(byte_buffer + bytes_read, run->data + run_offset, len);
+        bytes_read += len;
     }
 
-    return (size_t)r_u64.value;
+    return bytes_read;
 }
 
 
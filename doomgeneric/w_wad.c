@@ -61,9 +61,19 @@ typedef struct
 lumpinfo_t *lumpinfo;		
 unsigned int numlumps = 0;
 
-// Hash table for fast lookups
+char **wadfilenames = NULL;
+int numwadfiles = 0;
 
-static lumpinfo_t **lumphash;
+// Minimal perfect hash of the lump names, for fast lookups. Each name
+// is hashed once to find its bucket, and then again with that bucket's
+// seed to find its slot, which holds the lump W_CheckNumForName returns
+// for it. Names that aren't lumps can land on any slot, so the key
+// there still has to be checked.
+
+static unsigned int *lumphash_seeds;
+static unsigned int lumphash_numbuckets;
+static int *lumphash_slots;
+static unsigned int lumphash_numslots;
 
 // Hash function used for lump names.
 
@@ -83,6 +93,56 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+// Lump names as 64 bit keys: upper case, and zero padded to 8
+// characters, so that two names are the same if their keys are equal.
+
+uint64_t W_LumpNameKey(const char *s)
+{
+    uint64_t result = 0;
+    unsigned int i;
+
+    for (i=0; i < 8 && s[i] != '\0'; ++i)
+    {
+        result |= (uint64_t) (byte) toupper((byte) s[i]) << (i * 8);
+    }
+
+    return result;
+}
+
+// Hash a key with the given seed, for the perfect hash. This is the
+// finalizer from MurmurHash3, which mixes every bit of the key into
+// the result.
+
+static unsigned int LumpKeyHash(uint64_t key, unsigned int seed)
+{
+    key ^= seed * 0x9e3779b97f4a7c15ULL;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (unsigned int) key;
+}
+
+// Reduce a hash to the range 0 to n-1, without a division.
+
+static inline unsigned int HashRange(unsigned int hash, unsigned int n)
+{
+    return (unsigned int) (((uint64_t) hash * n) >> 32);
+}
+
+static void FreeHashTable(void)
+{
+    if (lumphash_slots != NULL)
+    {
+        Z_Free(lumphash_seeds);
+        Z_Free(lumphash_slots);
+        lumphash_seeds = NULL;
+        lumphash_slots = NULL;
+    }
+}
+
 // Increase the size of the lumpinfo[] array to the specified size.
 static void ExtendLumpInfo(int newnumlumps)
 {
@@ -107,14 +167,6 @@ static void ExtendLumpInfo(int newnumlumps)
         {
             Z_ChangeUser(newlumpinfo[i].cache, &newlumpinfo[i].cache);
         }
-
-        // We shouldn't be generating a hash table until after all WADs have
-        // been loaded, but just in case...
-        if (lumpinfo[i].next != NULL)
-        {
-            int nextlumpnum = lumpinfo[i].next - lumpinfo;
-            newlumpinfo[i].next = &newlumpinfo[nextlumpnum];
-        }
     }
 
     // All done.
@@ -158,6 +210,15 @@ wad_file_t *W_AddFile (char *filename)
 		return NULL;
     }
 
+    wadfilenames = realloc(wadfilenames, sizeof(char *) * (numwadfiles + 1));
+
+    if (wadfilenames == NULL)
+    {
+	I_Error ("Couldn't realloc wadfilenames");
+    }
+
+    wadfilenames[numwadfiles++] = M_StringDuplicate(filename);
+
     newnumlumps = numlumps;
 
     if (strcasecmp(filename+strlen(filename)-3 , "wad" ) )
@@ -223,6 +284,7 @@ wad_file_t *W_AddFile (char *filename)
 		lump_p->size = LONG(filerover->size);
 			lump_p->cache = NULL;
 		strncpy(lump_p->name, filerover->name, 8);
+		lump_p->key = W_LumpNameKey(lump_p->name);
 
 			++lump_p;
 			++filerover;
@@ -230,11 +292,7 @@ wad_file_t *W_AddFile (char *filename)
 
     Z_Free(fileinfo);
 
-    if (lumphash != NULL)
-    {
-        Z_Free(lumphash);
-        lumphash = NULL;
-    }
+    FreeHashTable();
 
     return wad_file;
 }
@@ -258,25 +316,26 @@ int W_NumLumps (void)
 
 int W_CheckNumForName (char* name)
 {
-    lumpinfo_t *lump_p;
+    uint64_t key;
+    unsigned int seed;
     int i;
 
+    key = W_LumpNameKey(name);
+
     // Do we have a hash table yet?
 
-    if (lumphash != NULL)
+    if (lumphash_slots != NULL)
     {
-        int hash;
-        
         // We do! Excellent.
 
-        hash = W_LumpNameHash(name) % numlumps;
-        
-        for (lump_p = lumphash[hash]; lump_p != NULL; lump_p = lump_p->next)
+        seed = lumphash_seeds[HashRange(LumpKeyHash(key, 0),
+                                        lumphash_numbuckets)];
+        i = lumphash_slots[HashRange(LumpKeyHash(key, seed),
+                                     lumphash_numslots)];
+
+        if (lumpinfo[i].key == key)
         {
-            if (!strncasecmp(lump_p->name, name, 8))
-            {
-                return lump_p - lumpinfo;
-            }
+            return i;
         }
     } 
     else
@@ -287,7 +346,7 @@ int W_CheckNumForName (char* name)
 
         for (i=numlumps-1; i >= 0; --i)
         {
-            if (!strncasecmp(lumpinfo[i].name, name, 8))
+            if (lumpinfo[i].key == key)
             {
                 return i;
             }
@@ -353,6 +412,15 @@ void W_ReadLump(unsigned int lump, void *dest)
     }
 
     l = lumpinfo+lump;
+
+    // If the lump is already cached (W_CacheLumpBatch may have read it
+    // ahead of time) there is no need to go back to the file.
+
+    if (l->cache != NULL && l->cache != dest)
+    {
+        memcpy(dest, l->cache, l->size);
+        return;
+    }
 	
     I_BeginRead ();
 	
@@ -382,6 +450,20 @@ void W_ReadLump(unsigned int lump, void *dest)
 // when no longer needed (do not use Z_ChangeTag).
 //
 
+// R_DrawColumn wraps the row into a texture column at 128, so the top
+// pixel of a sprite or patch column can be read from up to 127 bytes on,
+// past the end of the lump. Cached lumps are followed by that many zero
+// bytes, so that what it finds there doesn't depend on which zone block
+// happens to come next.
+
+#define LUMP_PADDING 128
+
+static void AllocLumpCache(lumpinfo_t *lump, int tag)
+{
+    Z_Malloc(lump->size + LUMP_PADDING, tag, &lump->cache);
+    memset((byte *) lump->cache + lump->size, 0, LUMP_PADDING);
+}
+
 void *W_CacheLumpNum(int lumpnum, int tag)
 {
     byte *result;
@@ -416,7 +498,7 @@ void *W_CacheLumpNum(int lumpnum, int tag)
     {
         // Not yet loaded, so load it now
 
-        lump->cache = Z_Malloc(W_LumpLength(lumpnum), tag, &lump->cache);
+        AllocLumpCache(lump, tag);
 	W_ReadLump (lumpnum, lump->cache);
         result = lump->cache;
     }
@@ -426,6 +508,186 @@ void *W_CacheLumpNum(int lumpnum, int tag)
 
 
 
+//
+// W_CacheLumpBatch
+//
+// Load a set of lumps into the cache together, as if with W_CacheLumpNum
+// on each of them in turn, but reading them in order of their position in
+// the WAD files and merging the reads of lumps that are close together.
+// The lumps are retrieved afterwards with W_CacheLumpNum as usual, which
+// will find them already loaded unless they were loaded as PU_CACHE and
+// have since been purged.
+//
+
+// Lumps no further apart than this are read together, along with the
+// data in between.
+#define BATCH_MAX_GAP   4096
+
+// The largest single read, and so the largest temporary buffer.
+#define BATCH_MAX_READ  (256 * 1024)
+
+static int CompareLumpPositions(const void *a, const void *b)
+{
+    const lumpinfo_t *x = &lumpinfo[*(const int *) a];
+    const lumpinfo_t *y = &lumpinfo[*(const int *) b];
+
+    if (x->wad_file != y->wad_file)
+    {
+        return x->wad_file < y->wad_file ? -1 : 1;
+    }
+
+    if (x->position != y->position)
+    {
+        return x->position < y->position ? -1 : 1;
+    }
+
+    // Keep any repeats of the same lump together.
+
+    return (x > y) - (x < y);
+}
+
+// Read lumps sorted[first] to sorted[last - 1], which are all in the same
+// file and span no more than BATCH_MAX_READ bytes, with a single read.
+
+static void ReadLumpRange(int *sorted, int first, int last, int tag)
+{
+    lumpinfo_t *l;
+    byte *buffer;
+    int start, end;
+    int c;
+    int i;
+
+    start = lumpinfo[sorted[first]].position;
+    end = start;
+    for (i = first; i < last; ++i)
+    {
+        l = &lumpinfo[sorted[i]];
+        if (l->position + l->size > end)
+        {
+            end = l->position + l->size;
+        }
+    }
+
+    buffer = Z_Malloc(end - start, PU_STATIC, NULL);
+
+    I_BeginRead ();
+
+    c = W_Read(lumpinfo[sorted[first]].wad_file, start, buffer, end - start);
+
+    if (c < end - start)
+    {
+	I_Error ("W_CacheLumpBatch: only read %i of %i at %i",
+		 c, end - start, start);
+    }
+
+    I_EndRead ();
+
+    for (i = first; i < last; ++i)
+    {
+        l = &lumpinfo[sorted[i]];
+
+        if (l->cache != NULL)
+        {
+            continue;
+        }
+
+        AllocLumpCache(l, tag);
+        memcpy(l->cache, buffer + l->position - start, l->size);
+    }
+
+    Z_Free(buffer);
+}
+
+void W_CacheLumpBatch(int *lumps, int count, int tag)
+{
+    lumpinfo_t *l;
+    int *sorted;
+    int numsorted;
+    int first, last;
+    int start, end;
+    int i;
+
+    sorted = Z_Malloc(count * sizeof(*sorted), PU_STATIC, NULL);
+    numsorted = 0;
+
+    for (i = 0; i < count; ++i)
+    {
+        if ((unsigned)lumps[i] >= numlumps)
+        {
+            I_Error ("W_CacheLumpBatch: %i >= numlumps", lumps[i]);
+        }
+
+        l = &lumpinfo[lumps[i]];
+
+        if (l->wad_file->mapped != NULL || l->size == 0)
+        {
+            // Nothing to read.
+        }
+        else if (l->cache != NULL)
+        {
+            // Already cached, so just switch the zone tag.
+            Z_ChangeTag(l->cache, tag);
+        }
+        else
+        {
+            sorted[numsorted++] = lumps[i];
+        }
+    }
+
+    qsort(sorted, numsorted, sizeof(*sorted), CompareLumpPositions);
+
+    for (first = 0; first < numsorted; first = last)
+    {
+        l = &lumpinfo[sorted[first]];
+        start = l->position;
+        end = l->position + l->size;
+
+        for (last = first + 1; last < numsorted; ++last)
+        {
+            l = &lumpinfo[sorted[last]];
+
+            // The same lump may have been asked for more than once.
+
+            if (sorted[last] == sorted[last - 1])
+            {
+                break;
+            }
+
+            if (l->wad_file != lumpinfo[sorted[first]].wad_file
+             || l->position > end + BATCH_MAX_GAP
+             || l->position + l->size - start > BATCH_MAX_READ)
+            {
+                break;
+            }
+
+            if (l->position + l->size > end)
+            {
+                end = l->position + l->size;
+            }
+        }
+
+        if (last == first + 1)
+        {
+            // Alone, so read it straight into its own buffer.
+
+            W_CacheLumpNum(sorted[first], tag);
+        }
+        else
+        {
+            ReadLumpRange(sorted, first, last, tag);
+        }
+
+        // Skip over any repeats of the last lump read.
+
+        while (last < numsorted && sorted[last] == sorted[last - 1])
+        {
+            ++last;
+        }
+    }
+
+    Z_Free(sorted);
+}
+
 //
 // W_CacheLumpName
 //
@@ -537,38 +799,226 @@ void W_Profile (void)
 
 #endif
 
+// Try to place every name in the perfect hash with the given number
+// of buckets. lumps[] holds the lump for each distinct name.
+
+static boolean PlaceHashBuckets(int *lumps, unsigned int numnames,
+                                unsigned int numbuckets)
+{
+    unsigned int *bucketstart;
+    unsigned int *bucketorder;
+    unsigned int *bucketlumps;
+    unsigned int *slots;
+    byte *used;
+    unsigned int b, i, j, k;
+    unsigned int seed;
+    unsigned int size;
+    boolean result = true;
+
+    // Sort the names into their buckets.
+
+    bucketstart = Z_Malloc((numbuckets + 1) * sizeof(*bucketstart),
+                           PU_STATIC, NULL);
+    bucketorder = Z_Malloc(numbuckets * sizeof(*bucketorder),
+                           PU_STATIC, NULL);
+    bucketlumps = Z_Malloc(numnames * sizeof(*bucketlumps), PU_STATIC, NULL);
+    slots = Z_Malloc(numnames * sizeof(*slots), PU_STATIC, NULL);
+    used = Z_Malloc(numnames, PU_STATIC, NULL);
+
+    memset(bucketstart, 0, (numbuckets + 1) * sizeof(*bucketstart));
+    memset(used, 0, numnames);
+
+    for (i=0; i<numnames; ++i)
+    {
+        b = HashRange(LumpKeyHash(lumpinfo[lumps[i]].key, 0), numbuckets);
+        ++bucketstart[b + 1];
+    }
+
+    for (b=0; b<numbuckets; ++b)
+    {
+        bucketstart[b + 1] += bucketstart[b];
+        bucketorder[b] = bucketstart[b];
+    }
+
+    for (i=0; i<numnames; ++i)
+    {
+        b = HashRange(LumpKeyHash(lumpinfo[lumps[i]].key, 0), numbuckets);
+        bucketlumps[bucketorder[b]++] = lumps[i];
+    }
+
+    // Place the biggest buckets first, while there is the most room.
+    // No bucket is likely to hold more than a few names, so a simple
+    // pass per size will do.
+
+    size = 0;
+    for (b=0; b<numbuckets; ++b)
+    {
+        if (bucketstart[b + 1] - bucketstart[b] > size)
+        {
+            size = bucketstart[b + 1] - bucketstart[b];
+        }
+    }
+
+    k = 0;
+    for (; size > 0; --size)
+    {
+        for (b=0; b<numbuckets; ++b)
+        {
+            if (bucketstart[b + 1] - bucketstart[b] == size)
+            {
+                bucketorder[k++] = b;
+            }
+        }
+    }
+
+    for (b=0; b<numbuckets; ++b)
+    {
+        lumphash_seeds[b] = 0;
+    }
+
+    for (j=0; j<k; ++j)
+    {
+        unsigned int first, count;
+
+        b = bucketorder[j];
+        first = bucketstart[b];
+        count = bucketstart[b + 1] - first;
+
+        for (seed=1; seed < (1 << 20); ++seed)
+        {
+            for (i=0; i<count; ++i)
+            {
+                slots[i] = HashRange(LumpKeyHash(lumpinfo[bucketlumps[first + i]].key,
+                                                 seed),
+                                     numnames);
+                if (used[slots[i]])
+                {
+                    break;
+                }
+                used[slots[i]] = 1;
+            }
+
+            if (i == count)
+            {
+                break;
+            }
+
+            // Clashed; undo this attempt.
+
+            while (i > 0)
+            {
+                --i;
+                used[slots[i]] = 0;
+            }
+        }
+
+        if (seed == (1 << 20))
+        {
+            result = false;
+            break;
+        }
+
+        lumphash_seeds[b] = seed;
+
+        for (i=0; i<count; ++i)
+        {
+            lumphash_slots[slots[i]] = bucketlumps[first + i];
+        }
+    }
+
+    Z_Free(bucketstart);
+    Z_Free(bucketorder);
+    Z_Free(bucketlumps);
+    Z_Free(slots);
+    Z_Free(used);
+
+    return result;
+}
+
 // Generate a hash table for fast lookups
 
 void W_GenerateHashTable(void)
 {
-    unsigned int i;
+    int *names;
+    int *lumps;
+    unsigned int numnames;
+    unsigned int tablesize;
+    unsigned int h;
+    int i;
 
     // Free the old hash table, if there is one
 
-    if (lumphash != NULL)
+    FreeHashTable();
+
+    if (numlumps == 0)
     {
-        Z_Free(lumphash);
+        return;
     }
 
-    // Generate hash table
-    if (numlumps > 0)
+    // Find the distinct names, and the last lump with each of them,
+    // which is the one that takes precedence. An open addressed table
+    // at most half full finds the duplicates.
+
+    tablesize = 1;
+    while (tablesize < numlumps * 2)
     {
-        lumphash = Z_Malloc(sizeof(lumpinfo_t *) * numlumps, PU_STATIC, NULL);
-        memset(lumphash, 0, sizeof(lumpinfo_t *) * numlumps);
+        tablesize <<= 1;
+    }
+
+    names = Z_Malloc(tablesize * sizeof(*names), PU_STATIC, NULL);
+    lumps = Z_Malloc(numlumps * sizeof(*lumps), PU_STATIC, NULL);
+
+    for (h=0; h<tablesize; ++h)
+    {
+        names[h] = -1;
+    }
+
+    numnames = 0;
 
-        for (i=0; i<numlumps; ++i)
+    for (i=numlumps-1; i >= 0; --i)
+    {
+        h = LumpKeyHash(lumpinfo[i].key, 0) & (tablesize - 1);
+
+        while (names[h] >= 0 && lumpinfo[names[h]].key != lumpinfo[i].key)
         {
-            unsigned int hash;
+            h = (h + 1) & (tablesize - 1);
+        }
+
+        if (names[h] < 0)
+        {
+            names[h] = i;
+            lumps[numnames++] = i;
+        }
+    }
 
-            hash = W_LumpNameHash(lumpinfo[i].name) % numlumps;
+    Z_Free(names);
 
-            // Hook into the hash table
+    // Generate hash table. Buckets average two names each; in the
+    // unlikely event that they can't all be placed, try again with
+    // smaller buckets.
 
-            lumpinfo[i].next = lumphash[hash];
-            lumphash[hash] = &lumpinfo[i];
+    lumphash_numslots = numnames;
+    lumphash_numbuckets = numnames / 2 + 1;
+    lumphash_slots = Z_Malloc(numnames * sizeof(*lumphash_slots),
+                              PU_STATIC, NULL);
+
+    for (;;)
+    {
+        lumphash_seeds = Z_Malloc(lumphash_numbuckets
+                                  * sizeof(*lumphash_seeds),
+                                  PU_STATIC, NULL);
+
+        if (PlaceHashBuckets(lumps, numnames, lumphash_numbuckets))
+        {
+            break;
         }
+
+        Z_Free(lumphash_seeds);
+        lumphash_numbuckets *= 2;
     }
 
+    Z_Free(lumps);
+
     // All done!
 }
 
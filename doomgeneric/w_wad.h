@@ -46,15 +46,20 @@ struct lumpinfo_s
     int		size;
     void       *cache;
 
-    // Used for hash table lookups
+    // The name as a W_LumpNameKey, for lookups.
 
-    lumpinfo_t *next;
+    uint64_t	key;
 };
 
 
 extern lumpinfo_t *lumpinfo;
 extern unsigned int numlumps;
 
+// The files W_AddFile has added, in order.
+
+extern char **wadfilenames;
+extern int numwadfiles;
+
 wad_file_t *W_AddFile (char *filename);
 
 int	W_CheckNumForName (char* name);
@@ -65,10 +70,12 @@ void    W_ReadLump (unsigned int lump, void *dest);
 
 void*	W_CacheLumpNum (int lump, int tag);
 void*	W_CacheLumpName (char* name, int tag);
+void	W_CacheLumpBatch (int *lumps, int count, int tag);
 
 void    W_GenerateHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
+extern uint64_t W_LumpNameKey(const char *s);
 
 void    W_ReleaseLumpNum(int lump);
 void    W_ReleaseLumpName(char *name);
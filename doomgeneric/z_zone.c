@@ -17,8 +17,14 @@
 //
 
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "z_zone.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
 #include "doomtype.h"
 
 
@@ -31,10 +37,49 @@
 //
 // It is of no value to free a cachable block,
 //  because it will get overwritten automatically if needed.
+//
+// Free blocks are also kept on segregated free lists, so that
+//  Z_Malloc can find one that fits without walking the block list.
+//  There is a list for each of SL_COUNT size classes between each
+//  power of two, with bitmaps of which lists are in use, as in
+//  TLSF ("Two-Level Segregated Fit"). Finding a block, splitting it
+//  and merging it again on Z_Free take the same time whatever the
+//  number of blocks. Only when nothing free is big enough does
+//  Z_Malloc fall back to walking the block list from the rover,
+//  purging cachable blocks until there is room.
+//
+// If that still doesn't make room, another region is added to the
+//  zone. Each region ends with a marker block that is never free, so
+//  the blocks of different regions are never merged; the block list
+//  runs through the regions in turn. With -zonetrim, regions added
+//  this way are given back by Z_FreeTags once they are empty again.
+//
+// Data that lasts until the end of the level, and is never freed
+//  before then, can be allocated with Z_LevelMalloc instead. It
+//  is packed one after another into large PU_LEVEL blocks, without
+//  a block header each, so that it is laid out in the order it is
+//  loaded and is freed a few blocks at a time.
+//
+// Things of one size that come and go all through a level, like
+//  thinkers, can be kept in a pool instead. Each pool takes room for
+//  several at a time from the level blocks, and keeps the ones freed
+//  on a list of its own to be reused, without going through the zone.
+//
+// Builds with FEATURE_ZONESTATS can also count the allocations for
+//  each tag and each call site, for -zonestats.
 // 
  
 #define MEM_ALIGN sizeof(void *)
 #define ZONEID	0x1d4a11
+#define REGIONID	0x1d4a12
+
+// Size classes: SL_COUNT per power of two from SMALL_BLOCK upwards,
+//  and SL_COUNT evenly spaced ones below it.
+#define SL_BITS		4
+#define SL_COUNT	(1 << SL_BITS)
+#define FL_SHIFT	8
+#define FL_COUNT	(32 - FL_SHIFT)
+#define SMALL_BLOCK	(1 << FL_SHIFT)
 
 typedef struct memblock_s
 {
@@ -44,6 +89,17 @@ typedef struct memblock_s
     int			id;	// should be ZONEID
     struct memblock_s*	next;
     struct memblock_s*	prev;
+
+    // Free list links, when this is free. These are in the header,
+    //  rather than the free space, because the game does read some
+    //  blocks again just after freeing them, as in P_RunThinkers.
+    struct memblock_s*	freenext;
+    struct memblock_s*	freeprev;
+
+#ifdef FEATURE_ZONESTATS
+    int			site;	// where it was allocated, in zonesites
+    int			time;	// when it was allocated, in ms
+#endif
 } memblock_t;
 
 
@@ -56,6 +112,18 @@ typedef struct
     memblock_t	blocklist;
     
     memblock_t*	rover;
+
+    // Free lists, and bitmaps of the ones that aren't empty.
+    unsigned int	fl_bitmap;
+    unsigned int	sl_bitmap[FL_COUNT];
+    memblock_t*		freelists[FL_COUNT][SL_COUNT];
+
+    // Totals of the blocks on the free lists.
+    int		freeblocks;
+    int		freebytes;
+
+    // Number of regions, including the first.
+    int		numregions;
     
 } memzone_t;
 
@@ -63,7 +131,695 @@ typedef struct
 
 memzone_t*	mainzone;
 
+static boolean	zonetrim;
+
+// The part of the current level block that Z_LevelMalloc has not
+//  used yet.
+static byte*	levelrover;
+static byte*	levelend;
+
+// Every pool passed to Z_PoolInit, to be emptied along with the level.
+static zpool_t*	pools;
+
+
+static inline int LowestBit (unsigned int x)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    int		i;
+
+    for (i = 0; !(x & 1); ++i)
+	x >>= 1;
+
+    return i;
+#endif
+}
+
+static inline int HighestBit (unsigned int x)
+{
+#ifdef __GNUC__
+    return 31 - __builtin_clz(x);
+#else
+    int		i;
+
+    for (i = -1; x != 0; ++i)
+	x >>= 1;
+
+    return i;
+#endif
+}
+
+// Find the free list for blocks of the given size.
+
+static inline void MapSize (int size, int *fl, int *sl)
+{
+    int		f;
+
+    if (size < SMALL_BLOCK)
+    {
+	*fl = 0;
+	*sl = size >> (FL_SHIFT - SL_BITS);
+    }
+    else
+    {
+	f = HighestBit(size);
+	*fl = f - FL_SHIFT + 1;
+	*sl = (size >> (f - SL_BITS)) - SL_COUNT;
+    }
+}
+
+static void InsertFreeBlock (memzone_t* zone, memblock_t* block)
+{
+    memblock_t*		head;
+    int			fl;
+    int			sl;
+
+    MapSize (block->size, &fl, &sl);
+
+    head = zone->freelists[fl][sl];
+    block->freeprev = NULL;
+    block->freenext = head;
+
+    if (head != NULL)
+	head->freeprev = block;
+
+    zone->freelists[fl][sl] = block;
+    zone->fl_bitmap |= 1U << fl;
+    zone->sl_bitmap[fl] |= 1U << sl;
+
+    ++zone->freeblocks;
+    zone->freebytes += block->size;
+}
+
+static void RemoveFreeBlock (memzone_t* zone, memblock_t* block)
+{
+    int			fl;
+    int			sl;
+
+    MapSize (block->size, &fl, &sl);
+
+    if (block->freenext != NULL)
+	block->freenext->freeprev = block->freeprev;
+
+    if (block->freeprev != NULL)
+    {
+	block->freeprev->freenext = block->freenext;
+    }
+    else
+    {
+	zone->freelists[fl][sl] = block->freenext;
+
+	if (block->freenext == NULL)
+	{
+	    zone->sl_bitmap[fl] &= ~(1U << sl);
+
+	    if (zone->sl_bitmap[fl] == 0)
+		zone->fl_bitmap &= ~(1U << fl);
+	}
+    }
+
+    --zone->freeblocks;
+    zone->freebytes -= block->size;
+}
+
+// Find a free block of at least the given size, or NULL if there is
+//  none. The size is rounded up to the next size class first, so
+//  that any block on the list found is big enough.
+
+static memblock_t* FindFreeBlock (memzone_t* zone, int size)
+{
+    unsigned int	bits;
+    int			fl;
+    int			sl;
+
+    if (size < SMALL_BLOCK)
+	size += (1 << (FL_SHIFT - SL_BITS)) - 1;
+    else
+	size += (1 << (HighestBit(size) - SL_BITS)) - 1;
+
+    MapSize (size, &fl, &sl);
+
+    if (fl >= FL_COUNT)
+	return NULL;
+
+    bits = zone->sl_bitmap[fl] & (~0U << sl);
+
+    if (bits == 0)
+    {
+	// Nothing in this power of two; take the next one up that has
+	//  anything at all.
+	bits = fl + 1 < FL_COUNT ? zone->fl_bitmap & (~0U << (fl + 1)) : 0;
+
+	if (bits == 0)
+	    return NULL;
+
+	fl = LowestBit(bits);
+	bits = zone->sl_bitmap[fl];
+    }
+
+    sl = LowestBit(bits);
+
+    return zone->freelists[fl][sl];
+}
+
+static void InitFreeLists (memzone_t* zone, memblock_t* block)
+{
+    memset (zone->freelists, 0, sizeof(zone->freelists));
+    memset (zone->sl_bitmap, 0, sizeof(zone->sl_bitmap));
+    zone->fl_bitmap = 0;
+    zone->freeblocks = 0;
+    zone->freebytes = 0;
+
+    InsertFreeBlock (zone, block);
+}
+
+
+
+// Put the end marker after the given block, which must be the last in
+//  its region, and link both in at the end of the block list.
+
+static void AddRegionEnd (memblock_t* block, byte* region)
+{
+    memblock_t*		marker;
+    memblock_t*		tail;
+
+    marker = (memblock_t *) ((byte *) block + block->size);
+    marker->size = sizeof(memblock_t);
+    marker->tag = PU_STATIC;
+    marker->id = REGIONID;
+    marker->user = (void **) region;
+
+    // The first region's block is already linked in.
+    if (block->next != &mainzone->blocklist)
+    {
+	tail = mainzone->blocklist.prev;
+	tail->next = block;
+	block->prev = tail;
+    }
+
+    block->next = marker;
+    marker->prev = block;
+    marker->next = &mainzone->blocklist;
+    mainzone->blocklist.prev = marker;
+}
+
+// Add another region to the zone, with a free block of at least the
+//  given size. Returns NULL if the zone can't grow.
+
+static memblock_t* AddRegion (int size)
+{
+    memblock_t*		block;
+    byte*		region;
+    int			regionsize;
+
+    regionsize = size + sizeof(memblock_t);
+    region = I_ZoneExtend (&regionsize);
+
+    if (region == NULL)
+	return NULL;
+
+    block = (memblock_t *) region;
+    block->size = regionsize - sizeof(memblock_t);
+    block->tag = PU_FREE;
+    block->user = NULL;
+    block->id = 0;
+    block->next = NULL;
+
+    AddRegionEnd (block, region);
+    InsertFreeBlock (mainzone, block);
+
+    mainzone->size += regionsize;
+    ++mainzone->numregions;
+
+    printf ("Z_Malloc: zone grown to %i KiB in %i regions\n",
+	    mainzone->size / 1024, mainzone->numregions);
+
+    return block;
+}
+
+// Give back any regions, other than the first, that are empty.
+
+static void TrimRegions (void)
+{
+    memblock_t*		block;
+    memblock_t*		marker;
+    memblock_t*		next;
+    int			regionsize;
+
+    for (marker = mainzone->blocklist.next ;
+	 marker != &mainzone->blocklist ;
+	 marker = next)
+    {
+	next = marker->next;
+
+	if (marker->id != REGIONID
+	 || (byte *) marker->user == (byte *) mainzone)
+	    continue;
+
+	// A region is empty if it is just one free block.
+	block = marker->prev;
+
+	if (block->tag != PU_FREE || (void **) block != marker->user)
+	    continue;
+
+	RemoveFreeBlock (mainzone, block);
+
+	block->prev->next = next;
+	next->prev = block->prev;
+
+	if (mainzone->rover == block || mainzone->rover == marker)
+	    mainzone->rover = next;
 
+	regionsize = block->size + marker->size;
+	mainzone->size -= regionsize;
+	--mainzone->numregions;
+
+	I_ZoneRelease ((byte *) block, regionsize);
+    }
+}
+
+
+#ifdef FEATURE_ZONESTATS
+
+//
+// ZONE STATISTICS
+//
+// Call sites are found by hashing their file name and line number,
+//  into a table with room for MAXSITES; once it is mostly full, new
+//  call sites are all counted as the first one, "(other)".
+//
+// Z_LevelMalloc and Z_PoolMalloc count what they take from the level
+//  blocks for their callers, and all of it as freed when the level
+//  blocks are. The level blocks themselves count towards PU_LEVEL
+//  and the "(level blocks)" call site.
+//
+
+#define MAXSITES	1024
+#define MAXLEVELS	128
+
+typedef struct
+{
+    const char*		file;
+    int			line;
+    int			tag;	// of the last allocation
+    zonestat_t		stat;
+
+    // What is still in use from the level blocks.
+    int			levelallocs;
+    int			levelbytes;
+    long long		leveltimes;	// when they were allocated, added up
+} zonesite_t;
+
+// One level's share of the whole zone's statistics.
+typedef struct
+{
+    char		name[9];
+    zonestat_t		start;
+    int			peakbytes;
+} zonelevel_t;
+
+boolean		zonestats;
+
+static char*	zonestats_filename;
+
+static zonestat_t	tagstats[PU_NUM_TAGS];
+
+static zonesite_t	zonesites[MAXSITES];
+static int		numsites;
+
+static zonelevel_t	zonelevels[MAXLEVELS];
+static int		numlevels;
+
+// Bytes in blocks that can't be purged, which is what -mb must hold.
+static int		fixedbytes;
+static int		peakfixed;
+
+// Times nothing free was big enough, so Z_Malloc had to purge.
+static unsigned int	purgeevents;
+
+static const char*	tagnames[PU_NUM_TAGS] =
+{
+    "(total)",
+    "PU_STATIC",
+    "PU_SOUND",
+    "PU_MUSIC",
+    "PU_FREE",
+    "PU_LEVEL",
+    "PU_LEVSPEC",
+    "PU_PURGELEVEL",
+    "PU_CACHE",
+};
+
+static int FindSite (const char* file, int line)
+{
+    unsigned int	hash;
+    const char*		c;
+    zonesite_t*		site;
+
+    hash = line;
+
+    for (c = file; *c != '\0'; ++c)
+	hash = hash * 31 + (byte) *c;
+
+    hash &= MAXSITES - 1;
+
+    // Slot 0 is "(other)".
+    if (hash == 0)
+	hash = 1;
+
+    for (;;)
+    {
+	site = &zonesites[hash];
+
+	if (site->file == NULL)
+	    break;
+
+	if (site->line == line
+	 && (site->file == file || !strcmp(site->file, file)))
+	    return hash;
+
+	hash = (hash + 1) & (MAXSITES - 1);
+
+	if (hash == 0)
+	    hash = 1;
+    }
+
+    if (numsites >= MAXSITES * 3 / 4)
+	return 0;
+
+    site->file = file;
+    site->line = line;
+    ++numsites;
+
+    return hash;
+}
+
+static void StatAdd (zonestat_t* stat, int size)
+{
+    ++stat->allocs;
+    stat->allocbytes += size;
+    stat->livebytes += size;
+
+    if (stat->livebytes > stat->peakbytes)
+	stat->peakbytes = stat->livebytes;
+}
+
+static void StatRemove (zonestat_t* stat, int size, int lifetime)
+{
+    ++stat->frees;
+    stat->livebytes -= size;
+    stat->lifetime += lifetime;
+}
+
+static void StatAlloc (memblock_t* block, const char* file, int line)
+{
+    zonesite_t*		site;
+
+    block->site = FindSite (file, line);
+    block->time = I_GetTimeMS ();
+
+    site = &zonesites[block->site];
+    site->tag = block->tag;
+
+    StatAdd (&site->stat, block->size);
+    StatAdd (&tagstats[block->tag], block->size);
+    StatAdd (&tagstats[0], block->size);
+
+    if (block->tag < PU_PURGELEVEL)
+    {
+	fixedbytes += block->size;
+
+	if (fixedbytes > peakfixed)
+	    peakfixed = fixedbytes;
+    }
+
+    if (numlevels > 0
+     && tagstats[0].livebytes > zonelevels[numlevels - 1].peakbytes)
+	zonelevels[numlevels - 1].peakbytes = tagstats[0].livebytes;
+}
+
+static void StatFree (memblock_t* block)
+{
+    int		lifetime;
+
+    lifetime = I_GetTimeMS () - block->time;
+
+    StatRemove (&zonesites[block->site].stat, block->size, lifetime);
+    StatRemove (&tagstats[block->tag], block->size, lifetime);
+    StatRemove (&tagstats[0], block->size, lifetime);
+
+    if (block->tag < PU_PURGELEVEL)
+	fixedbytes -= block->size;
+}
+
+static void StatPurge (memblock_t* block)
+{
+    zonestat_t*		stats[3];
+    int			i;
+
+    stats[0] = &zonesites[block->site].stat;
+    stats[1] = &tagstats[block->tag];
+    stats[2] = &tagstats[0];
+
+    for (i = 0; i < 3; ++i)
+    {
+	++stats[i]->purges;
+	stats[i]->purgebytes += block->size;
+    }
+}
+
+static void StatLevelAlloc (int size, const char* file, int line)
+{
+    zonesite_t*		site;
+
+    site = &zonesites[FindSite (file, line)];
+    site->tag = PU_LEVEL;
+
+    StatAdd (&site->stat, size);
+
+    ++site->levelallocs;
+    site->levelbytes += size;
+    site->leveltimes += I_GetTimeMS ();
+}
+
+static void StatLevelFree (void)
+{
+    zonesite_t*		site;
+    int			now;
+    int			i;
+
+    now = I_GetTimeMS ();
+
+    for (i = 0; i < MAXSITES; ++i)
+    {
+	site = &zonesites[i];
+
+	if (site->levelallocs == 0)
+	    continue;
+
+	site->stat.frees += site->levelallocs;
+	site->stat.livebytes -= site->levelbytes;
+	site->stat.lifetime += (long long) now * site->levelallocs
+			     - site->leveltimes;
+
+	site->levelallocs = 0;
+	site->levelbytes = 0;
+	site->leveltimes = 0;
+    }
+}
+
+static void StatChangeTag (memblock_t* block, int tag)
+{
+    zonestat_t*		stat;
+
+    // The block moves to the new tag as it is, without counting as
+    //  another allocation.
+
+    tagstats[block->tag].livebytes -= block->size;
+
+    stat = &tagstats[tag];
+    stat->livebytes += block->size;
+
+    if (stat->livebytes > stat->peakbytes)
+	stat->peakbytes = stat->livebytes;
+
+    if (block->tag < PU_PURGELEVEL && tag >= PU_PURGELEVEL)
+	fixedbytes -= block->size;
+    else if (block->tag >= PU_PURGELEVEL && tag < PU_PURGELEVEL)
+	fixedbytes += block->size;
+
+    if (fixedbytes > peakfixed)
+	peakfixed = fixedbytes;
+}
+
+const zonestat_t *Z_ZoneStats (int tag)
+{
+    return &tagstats[tag];
+}
+
+void Z_StatsLevel (const char* name)
+{
+    zonelevel_t*	level;
+
+    if (!zonestats || numlevels >= MAXLEVELS)
+	return;
+
+    level = &zonelevels[numlevels++];
+
+    strncpy (level->name, name, 8);
+    level->name[8] = '\0';
+    level->start = tagstats[0];
+    level->peakbytes = tagstats[0].livebytes;
+}
+
+static void WriteStat (FILE* f, const char* name, const zonestat_t* stat)
+{
+    fprintf (f, "%-28s %8u %8u %8u %10lld %10lld %8d %8d %10.1f\n",
+	     name, stat->allocs, stat->frees, stat->purges,
+	     stat->allocbytes / 1024, stat->purgebytes / 1024,
+	     stat->livebytes / 1024, stat->peakbytes / 1024,
+	     stat->frees > 0 ? (double) stat->lifetime / stat->frees : 0.0);
+}
+
+static void WriteStatHeader (FILE* f, const char* name)
+{
+    fprintf (f, "%-28s %8s %8s %8s %10s %10s %8s %8s %10s\n",
+	     name, "allocs", "frees", "purges", "alloc K", "purged K",
+	     "live K", "peak K", "life ms");
+}
+
+static int CompareSites (const void* a, const void* b)
+{
+    const zonesite_t*	sa = &zonesites[*(const int *) a];
+    const zonesite_t*	sb = &zonesites[*(const int *) b];
+
+    if (sa->stat.allocbytes != sb->stat.allocbytes)
+	return sa->stat.allocbytes > sb->stat.allocbytes ? -1 : 1;
+
+    return *(const int *) a - *(const int *) b;
+}
+
+static void Z_WriteStats (void)
+{
+    FILE*		f;
+    zonelevel_t*	level;
+    zonestat_t		end;
+    char		name[40];
+    int			sites[MAXSITES];
+    int			n;
+    int			i;
+
+    if (!zonestats)
+	return;
+
+    // Stop counting, so this only runs once.
+    zonestats = false;
+
+    f = fopen (zonestats_filename, "w");
+
+    if (f == NULL)
+    {
+	fprintf (stderr, "Z_WriteStats: failed to open %s\n",
+		 zonestats_filename);
+	return;
+    }
+
+    fprintf (f, "zone size %uK in %d regions\n",
+	     mainzone->size / 1024, mainzone->numregions);
+    fprintf (f, "peak in use %dK, of which %dK could not be purged\n",
+	     tagstats[0].peakbytes / 1024, peakfixed / 1024);
+    fprintf (f, "purged %u blocks, %lldK, when out of room %u times\n\n",
+	     tagstats[0].purges, tagstats[0].purgebytes / 1024,
+	     purgeevents);
+
+    WriteStatHeader (f, "tag");
+
+    for (i = 0; i < PU_NUM_TAGS; ++i)
+    {
+	if (i != PU_FREE)
+	    WriteStat (f, tagnames[i], &tagstats[i]);
+    }
+
+    if (numlevels > 0)
+    {
+	fprintf (f, "\n");
+	WriteStatHeader (f, "level");
+
+	for (i = 0; i < numlevels; ++i)
+	{
+	    level = &zonelevels[i];
+	    end = i + 1 < numlevels ? zonelevels[i + 1].start : tagstats[0];
+
+	    end.allocs -= level->start.allocs;
+	    end.frees -= level->start.frees;
+	    end.purges -= level->start.purges;
+	    end.allocbytes -= level->start.allocbytes;
+	    end.purgebytes -= level->start.purgebytes;
+	    end.lifetime -= level->start.lifetime;
+	    end.peakbytes = level->peakbytes;
+
+	    WriteStat (f, level->name, &end);
+	}
+    }
+
+    n = 0;
+
+    for (i = 0; i < MAXSITES; ++i)
+    {
+	if (zonesites[i].stat.allocs > 0)
+	    sites[n++] = i;
+    }
+
+    qsort (sites, n, sizeof(int), CompareSites);
+
+    fprintf (f, "\n");
+    WriteStatHeader (f, "call site");
+
+    for (i = 0; i < n; ++i)
+    {
+	zonesite_t*	site = &zonesites[sites[i]];
+
+	if (site->file != NULL && site->line == 0)
+	    M_snprintf (name, sizeof(name), "%s", site->file);
+	else if (site->file != NULL)
+	    M_snprintf (name, sizeof(name), "%s:%d", site->file, site->line);
+	else
+	    M_snprintf (name, sizeof(name), "(other)");
+
+	WriteStat (f, name, &site->stat);
+    }
+
+    fclose (f);
+    printf ("Z_WriteStats: wrote %s\n", zonestats_filename);
+}
+
+static void Z_StatsInit (void)
+{
+    int		p;
+
+    //!
+    // @arg <file>
+    // @category obscure
+    //
+    // Count zone memory allocations, frees and purges for each tag, each
+    // level and each place they are made from, and on exit write them
+    // with the peak memory use to the given file. Only available in
+    // builds with FEATURE_ZONESTATS.
+    //
+
+    p = M_CheckParmWithArgs ("-zonestats", 1);
+
+    if (!p)
+	return;
+
+    zonestats_filename = myargv[p + 1];
+    zonestats = true;
+
+    I_AtExit (Z_WriteStats, true);
+}
+
+#endif
 
 //
 // Z_ClearZone
@@ -87,6 +843,8 @@ void Z_ClearZone (memzone_t* zone)
     block->tag = PU_FREE;
 
     block->size = zone->size - sizeof(memzone_t);
+
+    InitFreeLists (zone, block);
 }
 
 
@@ -117,6 +875,28 @@ void Z_Init (void)
     block->tag = PU_FREE;
     
     block->size = mainzone->size - sizeof(memzone_t);
+
+    InitFreeLists (mainzone, block);
+
+    // The first region needs an end marker too, once there are others.
+    RemoveFreeBlock (mainzone, block);
+    block->size -= sizeof(memblock_t);
+    AddRegionEnd (block, (byte *) mainzone);
+    InsertFreeBlock (mainzone, block);
+    mainzone->numregions = 1;
+
+    //!
+    // @category obscure
+    //
+    // Give memory that the zone grew by back to the system when it is
+    // no longer used, between levels.
+    //
+
+    zonetrim = M_CheckParm("-zonetrim") > 0;
+
+#ifdef FEATURE_ZONESTATS
+    Z_StatsInit ();
+#endif
 }
 
 
@@ -139,6 +919,11 @@ void Z_Free (void* ptr)
 	    *block->user = 0;
     }
 
+#ifdef FEATURE_ZONESTATS
+    if (zonestats)
+	StatFree (block);
+#endif
+
     // mark as free
     block->tag = PU_FREE;
     block->user = NULL;
@@ -149,6 +934,7 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge with previous free block
+        RemoveFreeBlock (mainzone, other);
         other->size += block->size;
         other->next = block->next;
         other->next->prev = other;
@@ -163,6 +949,7 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge the next free block onto the end
+        RemoveFreeBlock (mainzone, other);
         block->size += other->size;
         block->next = other->next;
         block->next->prev = block;
@@ -170,40 +957,25 @@ void Z_Free (void* ptr)
         if (other == mainzone->rover)
             mainzone->rover = block;
     }
+
+    InsertFreeBlock (mainzone, block);
 }
 
 
 
 //
-// Z_Malloc
-// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+// PurgeForBlock
+// Nothing free is big enough, so scan through the block list for
+//  the first run of free and purgable blocks of sufficient size,
+//  throwing out the purgable blocks along the way. Returns NULL if
+//  there isn't one.
 //
-#define MINFRAGMENT		64
-
-
-void*
-Z_Malloc
-( int		size,
-  int		tag,
-  void*		user )
+static memblock_t* PurgeForBlock (int size)
 {
-    int		extra;
     memblock_t*	start;
     memblock_t* rover;
-    memblock_t* newblock;
     memblock_t*	base;
-    void *result;
-
-    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
-    
-    // scan through the block list,
-    // looking for the first free block
-    // of sufficient size,
-    // throwing out any purgable blocks along the way.
 
-    // account for size of block header
-    size += sizeof(memblock_t);
-    
     // if there is a free block behind the rover,
     //  back up over them
     base = mainzone->rover;
@@ -219,7 +991,7 @@ Z_Malloc
         if (rover == start)
         {
             // scanned all the way around the list
-            I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+            return NULL;
         }
 	
         if (rover->tag != PU_FREE)
@@ -234,6 +1006,11 @@ Z_Malloc
             {
                 // free the rover block (adding the size to base)
 
+#ifdef FEATURE_ZONESTATS
+                if (zonestats)
+                    StatPurge (rover);
+#endif
+
                 // the rover can be the base block
                 base = base->prev;
                 Z_Free ((byte *)rover+sizeof(memblock_t));
@@ -248,6 +1025,53 @@ Z_Malloc
 
     } while (base->tag != PU_FREE || base->size < size);
 
+    return base;
+}
+
+
+
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+//
+#define MINFRAGMENT		64
+
+
+void*
+Z_Malloc2
+( int		size,
+  int		tag,
+  void*		user,
+  const char*	file,
+  int		line )
+{
+    int		extra;
+    memblock_t* newblock;
+    memblock_t*	base;
+    void *result;
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+    
+    // account for size of block header
+    size += sizeof(memblock_t);
+
+    base = FindFreeBlock (mainzone, size);
+
+    if (base == NULL)
+    {
+#ifdef FEATURE_ZONESTATS
+        ++purgeevents;
+#endif
+        base = PurgeForBlock (size);
+    }
+
+    if (base == NULL)
+        base = AddRegion (size);
+
+    if (base == NULL)
+        I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+
+    RemoveFreeBlock (mainzone, base);
     
     // found a block big enough
     extra = base->size - size;
@@ -266,6 +1090,8 @@ Z_Malloc
 
         base->next = newblock;
         base->size = size;
+
+        InsertFreeBlock (mainzone, newblock);
     }
 	
 	if (user == NULL && tag >= PU_PURGELEVEL)
@@ -281,16 +1107,139 @@ Z_Malloc
         *base->user = result;
     }
 
-    // next allocation will start looking here
+    // next purge will start looking here
     mainzone->rover = base->next;	
 	
     base->id = ZONEID;
+
+#ifdef FEATURE_ZONESTATS
+    if (zonestats)
+	StatAlloc (base, file, line);
+#endif
     
     return result;
 }
 
 
 
+//
+// Z_LevelReserve
+// Start a new level block, if there isn't room in the current one
+//  for the given number of bytes, so that they are allocated together.
+//
+#define LEVELCHUNK	(16 * 1024)
+
+void Z_LevelReserve (int size)
+{
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+    if (levelend - levelrover >= size)
+	return;
+
+    levelrover = Z_Malloc2 (size, PU_LEVEL, NULL, "(level blocks)", 0);
+    levelend = levelrover + size;
+}
+
+
+
+//
+// Z_LevelMalloc
+// Allocate memory that is freed along with the rest of the level by
+//  Z_FreeTags. It can't be freed with Z_Free.
+//
+void* Z_LevelMalloc2 (int size, const char* file, int line)
+{
+    void*	result;
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+    if (levelend - levelrover < size)
+	Z_LevelReserve (size > LEVELCHUNK ? size : LEVELCHUNK);
+
+    result = levelrover;
+    levelrover += size;
+
+#ifdef FEATURE_ZONESTATS
+    if (zonestats)
+	StatLevelAlloc (size, file, line);
+#endif
+
+    return result;
+}
+
+
+
+//
+// Z_PoolInit
+// Set up a pool of things of the given size, allocated from the level
+//  blocks a number at a time. The pool is emptied whenever the level
+//  blocks are freed.
+//
+void Z_PoolInit (zpool_t* pool, int size, int perchunk)
+{
+    if (pool->size == 0)
+    {
+	pool->next = pools;
+	pools = pool;
+    }
+
+    pool->size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+    pool->perchunk = perchunk;
+    pool->freelist = NULL;
+    pool->rover = pool->end = NULL;
+    pool->inuse = 0;
+    pool->allocated = 0;
+    pool->peak = 0;
+}
+
+
+
+//
+// Z_PoolMalloc
+//
+void* Z_PoolMalloc2 (zpool_t* pool, const char* file, int line)
+{
+    void*	result;
+
+    if (pool->freelist != NULL)
+    {
+	result = pool->freelist;
+	pool->freelist = *(void **) result;
+    }
+    else
+    {
+	if (pool->rover == pool->end)
+	{
+	    pool->rover = Z_LevelMalloc2 (pool->size * pool->perchunk,
+					  file, line);
+	    pool->end = pool->rover + pool->size * pool->perchunk;
+	    pool->allocated += pool->perchunk;
+	}
+
+	result = pool->rover;
+	pool->rover += pool->size;
+    }
+
+    if (++pool->inuse > pool->peak)
+	pool->peak = pool->inuse;
+
+    return result;
+}
+
+
+
+//
+// Z_PoolFree
+//
+void Z_PoolFree (zpool_t* pool, void* ptr)
+{
+    *(void **) ptr = pool->freelist;
+    pool->freelist = ptr;
+    pool->inuse--;
+}
+
+
+
 //
 // Z_FreeTags
 //
@@ -309,13 +1258,32 @@ Z_FreeTags
 	// get link before freeing
 	next = block->next;
 
-	// free block?
-	if (block->tag == PU_FREE)
+	// free block, or the end of a region?
+	if (block->tag == PU_FREE || block->id == REGIONID)
 	    continue;
 	
 	if (block->tag >= lowtag && block->tag <= hightag)
 	    Z_Free ( (byte *)block+sizeof(memblock_t));
     }
+
+    // The level blocks have gone, and the pools with them.
+    if (lowtag <= PU_LEVEL && hightag >= PU_LEVEL)
+    {
+	zpool_t*	pool;
+
+	levelrover = levelend = NULL;
+
+	for (pool = pools; pool != NULL; pool = pool->next)
+	    Z_PoolInit (pool, pool->size, pool->perchunk);
+
+#ifdef FEATURE_ZONESTATS
+	if (zonestats)
+	    StatLevelFree ();
+#endif
+    }
+
+    if (zonetrim)
+	TrimRegions ();
 }
 
 
@@ -349,7 +1317,8 @@ Z_DumpHeap
 	    break;
 	}
 	
-	if ( (byte *)block + block->size != (byte *)block->next)
+	if (block->id != REGIONID
+	 && (byte *)block + block->size != (byte *)block->next)
 	    printf ("ERROR: block size does not touch the next block\n");
 
 	if ( block->next->prev != block)
@@ -381,7 +1350,8 @@ void Z_FileDumpHeap (FILE* f)
 	    break;
 	}
 	
-	if ( (byte *)block + block->size != (byte *)block->next)
+	if (block->id != REGIONID
+	 && (byte *)block + block->size != (byte *)block->next)
 	    fprintf (f,"ERROR: block size does not touch the next block\n");
 
 	if ( block->next->prev != block)
@@ -394,6 +1364,71 @@ void Z_FileDumpHeap (FILE* f)
 
 
 
+//
+// Z_CheckFreeLists
+// Every free block must be on the free list for its size, and
+//  nothing else may be.
+//
+static void Z_CheckFreeLists (void)
+{
+    memblock_t*	block;
+    int		freeblocks;
+    int		freebytes;
+    int		fl;
+    int		sl;
+    int		blockfl;
+    int		blocksl;
+
+    freeblocks = freebytes = 0;
+
+    for (fl = 0; fl < FL_COUNT; ++fl)
+    {
+	for (sl = 0; sl < SL_COUNT; ++sl)
+	{
+	    block = mainzone->freelists[fl][sl];
+
+	    if ((block != NULL) != ((mainzone->sl_bitmap[fl] >> sl) & 1))
+		I_Error ("Z_CheckHeap: free list bitmap is wrong\n");
+
+	    for ( ; block != NULL; block = block->freenext)
+	    {
+		MapSize (block->size, &blockfl, &blocksl);
+
+		if (block->tag != PU_FREE
+		 || blockfl != fl || blocksl != sl)
+		    I_Error ("Z_CheckHeap: bad block on free list\n");
+
+		++freeblocks;
+		freebytes += block->size;
+	    }
+	}
+
+	if ((mainzone->sl_bitmap[fl] != 0) != ((mainzone->fl_bitmap >> fl) & 1))
+	    I_Error ("Z_CheckHeap: free list bitmap is wrong\n");
+    }
+
+    if (freeblocks != mainzone->freeblocks
+     || freebytes != mainzone->freebytes)
+	I_Error ("Z_CheckHeap: free lists don't match the free blocks\n");
+
+    // Every free block in the zone must have been on a list.
+
+    freeblocks = 0;
+
+    for (block = mainzone->blocklist.next ;
+         block != &mainzone->blocklist;
+         block = block->next)
+    {
+	if (block->tag == PU_FREE)
+	    ++freeblocks;
+    }
+
+    if (freeblocks != mainzone->freeblocks)
+	I_Error ("Z_CheckHeap: free block missing from the free lists\n");
+}
+
+
+
 //
 // Z_CheckHeap
 //
@@ -409,7 +1444,8 @@ void Z_CheckHeap (void)
 	    break;
 	}
 	
-	if ( (byte *)block + block->size != (byte *)block->next)
+	if (block->id != REGIONID
+	 && (byte *)block + block->size != (byte *)block->next)
 	    I_Error ("Z_CheckHeap: block size does not touch the next block\n");
 
 	if ( block->next->prev != block)
@@ -418,6 +1454,8 @@ void Z_CheckHeap (void)
 	if (block->tag == PU_FREE && block->next->tag == PU_FREE)
 	    I_Error ("Z_CheckHeap: two consecutive free blocks\n");
     }
+
+    Z_CheckFreeLists ();
 }
 
 
@@ -440,6 +1478,11 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
         I_Error("%s:%i: Z_ChangeTag: an owner is required "
                 "for purgable blocks", file, line);
 
+#ifdef FEATURE_ZONESTATS
+    if (zonestats)
+	StatChangeTag (block, tag);
+#endif
+
     block->tag = tag;
 }
 
@@ -481,6 +1524,61 @@ int Z_FreeMemory (void)
     return free;
 }
 
+//
+// Z_MemoryStats
+// Breaks the zone down into bytes in use, free and purgable.
+//
+void Z_MemoryStats (int *used, int *free, int *purgeable)
+{
+    memblock_t*		block;
+
+    *used = *free = *purgeable = 0;
+
+    for (block = mainzone->blocklist.next ;
+         block != &mainzone->blocklist;
+         block = block->next)
+    {
+        if (block->tag == PU_FREE)
+            *free += block->size;
+        else if (block->tag >= PU_PURGELEVEL)
+            *purgeable += block->size;
+        else
+            *used += block->size;
+    }
+}
+
+//
+// Z_Fragmentation
+// How much of the free memory is not in the largest free block, as a
+//  percentage, and the size of that block.
+//
+int Z_Fragmentation (int *largest)
+{
+    memblock_t*		block;
+    int			fl;
+    int			sl;
+
+    *largest = 0;
+
+    if (mainzone->fl_bitmap == 0)
+        return 0;
+
+    // The largest block is on the highest free list in use.
+
+    fl = HighestBit(mainzone->fl_bitmap);
+    sl = HighestBit(mainzone->sl_bitmap[fl]);
+
+    for (block = mainzone->freelists[fl][sl];
+         block != NULL;
+         block = block->freenext)
+    {
+        if (block->size > *largest)
+            *largest = block->size;
+    }
+
+    return 100 - (int) ((long long) *largest * 100 / mainzone->freebytes);
+}
+
 unsigned int Z_ZoneSize(void)
 {
     return mainzone->size;
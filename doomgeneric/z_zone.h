@@ -26,6 +26,8 @@
 
 #include <stdio.h>
 
+#include "doomtype.h"
+
 //
 // ZONE MEMORY
 // PU - purge tags.
@@ -49,9 +51,30 @@ enum
     PU_NUM_TAGS
 };
         
+//
+// A pool of things of one size, allocated from the level blocks.
+//
+typedef struct zpool_s
+{
+    int			size;
+    int			perchunk;	// taken from the level blocks at a time
+    void*		freelist;
+    byte*		rover;		// the rest of the last chunk taken
+    byte*		end;
+    int			inuse;
+    int			allocated;	// including the free ones
+    int			peak;		// most in use since the level started
+    struct zpool_s*	next;
+} zpool_t;
+
 
 void	Z_Init (void);
-void*	Z_Malloc (int size, int tag, void *ptr);
+void*	Z_Malloc2 (int size, int tag, void *ptr, const char *file, int line);
+void*	Z_LevelMalloc2 (int size, const char *file, int line);
+void	Z_LevelReserve (int size);
+void	Z_PoolInit (zpool_t *pool, int size, int perchunk);
+void*	Z_PoolMalloc2 (zpool_t *pool, const char *file, int line);
+void	Z_PoolFree (zpool_t *pool, void *ptr);
 void    Z_Free (void *ptr);
 void    Z_FreeTags (int lowtag, int hightag);
 void    Z_DumpHeap (int lowtag, int hightag);
@@ -60,14 +83,60 @@ void    Z_CheckHeap (void);
 void    Z_ChangeTag2 (void *ptr, int tag, char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
 int     Z_FreeMemory (void);
+void    Z_MemoryStats (int *used, int *free, int *purgeable);
+int     Z_Fragmentation (int *largest);
 unsigned int Z_ZoneSize(void);
 
 //
 // This is used to get the local FILE:LINE info from CPP
 // prior to really call the function in question.
 //
+#define Z_Malloc(s,t,p)                                        \
+    Z_Malloc2((s), (t), (p), __FILE__, __LINE__)
+
 #define Z_ChangeTag(p,t)                                       \
     Z_ChangeTag2((p), (t), __FILE__, __LINE__)
 
+#define Z_LevelMalloc(s)                                       \
+    Z_LevelMalloc2((s), __FILE__, __LINE__)
+
+#define Z_PoolMalloc(p)                                        \
+    Z_PoolMalloc2((p), __FILE__, __LINE__)
+
+
+#ifdef FEATURE_ZONESTATS
+
+//
+// Allocation statistics for -zonestats, kept for each tag and each
+// place Z_Malloc is called from. Sizes include the block headers.
+//
+typedef struct
+{
+    unsigned int	allocs;
+    unsigned int	frees;		// including purges
+    unsigned int	purges;		// thrown out by Z_Malloc to make room
+    long long		allocbytes;
+    long long		purgebytes;
+    long long		lifetime;	// total ms that freed blocks were kept
+    int			livebytes;
+    int			peakbytes;
+} zonestat_t;
+
+// True when -zonestats was given.
+extern boolean zonestats;
+
+// The statistics for a tag, or for the whole zone with tag 0.
+const zonestat_t *Z_ZoneStats (int tag);
+
+// Start counting the statistics for a new level.
+void Z_StatsLevel (const char *name);
+
+#else
+
+#define Z_StatsLevel(name)
+
+#endif
+
+
 
 #endif